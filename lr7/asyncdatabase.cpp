@@ -0,0 +1,320 @@
+#include "asyncdatabase.h"
+#include <QDebug>
+#include <QJSEngine>
+#include <QMutexLocker>
+
+AsyncDatabase::AsyncDatabase(QObject *parent)
+    : QObject(parent), m_writer(new Database), m_nextRequestId(0)
+{
+    m_writer->moveToThread(&m_writerThread);
+    connect(&m_writerThread, &QThread::finished, m_writer, &QObject::deleteLater);
+    // Сигналы пишущего соединения доходят до потока GUI через очередь событий
+    connect(m_writer, &Database::bookInserted, this, &AsyncDatabase::bookInserted);
+    connect(m_writer, &Database::bookUpdated, this, &AsyncDatabase::bookUpdated);
+    connect(m_writer, &Database::bookDeleted, this, &AsyncDatabase::bookDeleted);
+    connect(m_writer, &Database::loanChanged, this, &AsyncDatabase::loanChanged);
+    connect(m_writer, &Database::readerInserted, this, &AsyncDatabase::readerInserted);
+    connect(m_writer, &Database::readerUpdated, this, &AsyncDatabase::readerUpdated);
+    connect(m_writer, &Database::readerDeleted, this, &AsyncDatabase::readerDeleted);
+    connect(m_writer, &Database::importProgress, this, &AsyncDatabase::importProgress);
+    connect(m_writer, &Database::importFinished, this, &AsyncDatabase::importFinished);
+    connect(m_writer, &Database::databaseRestored, this, &AsyncDatabase::databaseRestored);
+    m_writerThread.setObjectName("DatabaseWriter");
+    m_writerThread.start();
+}
+
+AsyncDatabase::~AsyncDatabase()
+{
+    // Сначала дожидаемся читающих задач, затем закрываем пишущее соединение:
+    // оно удаляется в своём потоке по сигналу finished
+    m_readers.reset();
+    m_writerThread.quit();
+    m_writerThread.wait();
+}
+
+bool AsyncDatabase::open(const QString &path, const DatabaseOptions &options, int readConnections)
+{
+    // Соединение должно создаваться в том потоке, где будет использоваться
+    bool connected = false;
+    QMetaObject::invokeMethod(m_writer, [this, path, options, &connected]() {
+        connected = m_writer->connectToDatabase(path, "library_writer", options);
+    }, Qt::BlockingQueuedConnection);
+    if (!connected) {
+        qDebug() << "Async database: writer connection failed";
+        return false;
+    }
+
+    m_readers.reset(new ReadConnectionPool(path, readConnections, options));
+    return true;
+}
+
+int AsyncDatabase::searchBooksAdvanced(const QString &searchTerm, int minYear, int maxYear, bool onlyAvailable,
+                                       const QString &author, const QString &genre, const QJSValue &callback)
+{
+    // Новый поиск вытесняет предыдущий, пока пользователь продолжает набирать текст
+    return submitScript("search", callback, [=](Database *db) {
+        return QVariant(db->searchBooksAdvanced(searchTerm, minYear, maxYear, onlyAvailable, author, genre));
+    });
+}
+
+int AsyncDatabase::searchBooksRanked(const QString &searchTerm, int limit, const QJSValue &callback)
+{
+    return submitScript("search", callback, [=](Database *db) {
+        return QVariant(db->searchBooksRanked(searchTerm, limit));
+    });
+}
+
+int AsyncDatabase::facetCounts(const QString &searchTerm, int minYear, int maxYear, bool onlyAvailable,
+                               const QString &author, const QString &genre, int limit, const QJSValue &callback)
+{
+    // Счётчики панели пересчитываются вслед за фильтром списка и так же вытесняют устаревшие
+    return submitScript("facets", callback, [=](Database *db) {
+        return QVariant(db->facetCounts(searchTerm, minYear, maxYear, onlyAvailable, author, genre, limit));
+    });
+}
+
+int AsyncDatabase::getAllBooks(const QJSValue &callback)
+{
+    return submitScript(QString(), callback, [](Database *db) {
+        return QVariant(db->getAllBooks());
+    });
+}
+
+int AsyncDatabase::getAllReaders(const QJSValue &callback)
+{
+    return submitScript(QString(), callback, [](Database *db) {
+        return QVariant(db->getAllReaders());
+    });
+}
+
+int AsyncDatabase::overdueLoans(int limit, const QJSValue &callback)
+{
+    return submitScript(QString(), callback, [=](Database *db) {
+        return QVariant(db->overdueLoans(limit));
+    });
+}
+
+int AsyncDatabase::readerLoanHistory(int readerId, int limit, const QJSValue &callback)
+{
+    // При переходе к другому читателю история прежнего уже не нужна
+    return submitScript("readerLoanHistory", callback, [=](Database *db) {
+        return QVariant(db->readerLoanHistory(readerId, limit));
+    });
+}
+
+int AsyncDatabase::loansPerDay(const QDateTime &from, const QDateTime &to, const QJSValue &callback)
+{
+    return submitScript("loansPerDay", callback, [=](Database *db) {
+        return QVariant(db->loansPerDay(from, to));
+    });
+}
+
+int AsyncDatabase::exportBooks(const QString &filePath, const QString &format, const QJSValue &callback)
+{
+    // Идентификатор нужен самой задаче: по нему она проверяет отмену и сообщает о ходе выгрузки
+    int requestId = registerRequest(QString());
+    BookExporter::Format exportFormat = BookExporter::formatFromName(format);
+    return submitScript(requestId, QString(), callback, [this, requestId, filePath, exportFormat](Database *db) {
+        qint64 totalRows = db->countBooksMatching(BookFilter());
+        bool success = db->exportBooks(filePath, exportFormat, [this, requestId, totalRows](qint64 rowsWritten) {
+            emit exportProgress(requestId, rowsWritten, totalRows);
+        }, [this, requestId]() {
+            return isStale(requestId, QString());
+        });
+        return QVariant(success);
+    }, Read);
+}
+
+int AsyncDatabase::backupDatabase(const QString &filePath, const QJSValue &callback)
+{
+    return submitCopy(filePath, callback, Read, [](Database *db, const QString &path,
+                                                   const std::function<void(int, int)> &progress,
+                                                   const std::function<bool()> &cancelled) {
+        return db->backupTo(path, progress, cancelled);
+    });
+}
+
+int AsyncDatabase::restoreDatabase(const QString &filePath, const QJSValue &callback)
+{
+    return submitCopy(filePath, callback, Write, [](Database *db, const QString &path,
+                                                    const std::function<void(int, int)> &progress,
+                                                    const std::function<bool()> &cancelled) {
+        return db->restoreFrom(path, progress, cancelled);
+    });
+}
+
+int AsyncDatabase::compactDatabase(const QString &filePath, const QJSValue &callback)
+{
+    return submitScript(QString(), callback, [=](Database *db) {
+        return QVariant(db->compactTo(filePath));
+    });
+}
+
+int AsyncDatabase::importBooksFromCSV(const QString &filePath, int batchSize, const QJSValue &callback)
+{
+    return submitScript(QString(), callback, [=](Database *db) {
+        return QVariant(db->importBooksFromCSV(filePath, batchSize));
+    }, Write);
+}
+
+int AsyncDatabase::importReadersFromCSV(const QString &filePath, int batchSize, const QJSValue &callback)
+{
+    return submitScript(QString(), callback, [=](Database *db) {
+        return QVariant(db->importReadersFromCSV(filePath, batchSize));
+    }, Write);
+}
+
+int AsyncDatabase::addBook(const QString &title, const QString &author, int year, const QString &genre,
+                           const QJSValue &callback)
+{
+    return submitScript(QString(), callback, [=](Database *db) {
+        return QVariant(db->addBook(title, author, year, genre));
+    }, Write);
+}
+
+int AsyncDatabase::updateBook(int id, const QString &title, const QString &author, int year, const QString &genre,
+                              const QJSValue &callback)
+{
+    return submitScript(QString(), callback, [=](Database *db) {
+        return QVariant(db->updateBook(id, title, author, year, genre));
+    }, Write);
+}
+
+int AsyncDatabase::deleteBook(int id, const QJSValue &callback)
+{
+    return submitScript(QString(), callback, [=](Database *db) {
+        return QVariant(db->deleteBook(id));
+    }, Write);
+}
+
+int AsyncDatabase::addReader(const QString &name, const QString &contact, const QJSValue &callback)
+{
+    return submitScript(QString(), callback, [=](Database *db) {
+        return QVariant(db->addReader(name, contact));
+    }, Write);
+}
+
+int AsyncDatabase::updateReader(int id, const QString &name, const QString &contact, const QJSValue &callback)
+{
+    return submitScript(QString(), callback, [=](Database *db) {
+        return QVariant(db->updateReader(id, name, contact));
+    }, Write);
+}
+
+int AsyncDatabase::deleteReader(int id, const QJSValue &callback)
+{
+    return submitScript(QString(), callback, [=](Database *db) {
+        return QVariant(db->deleteReader(id));
+    }, Write);
+}
+
+int AsyncDatabase::issueBook(int bookId, int readerId, const QJSValue &callback)
+{
+    return submitScript(QString(), callback, [=](Database *db) {
+        return QVariant(db->issueBook(bookId, readerId));
+    }, Write);
+}
+
+int AsyncDatabase::issueBooks(int readerId, const QVariantList &bookIds, const QJSValue &callback)
+{
+    return submitScript(QString(), callback, [=](Database *db) {
+        return QVariant(db->issueBooks(readerId, bookIds));
+    }, Write);
+}
+
+int AsyncDatabase::returnBook(int bookId, const QJSValue &callback)
+{
+    return submitScript(QString(), callback, [=](Database *db) {
+        return QVariant(db->returnBook(bookId));
+    }, Write);
+}
+
+void AsyncDatabase::cancel(int requestId)
+{
+    // Завершённый запрос уже не выполняется и не доставляется: его идентификатор
+    // иначе остался бы в m_cancelled навсегда
+    QMutexLocker locker(&m_mutex);
+    if (m_inFlight.contains(requestId)) {
+        m_cancelled.insert(requestId);
+    }
+}
+
+int AsyncDatabase::registerRequest(const QString &staleKey)
+{
+    QMutexLocker locker(&m_mutex);
+    int requestId = ++m_nextRequestId;
+    m_inFlight.insert(requestId);
+    if (!staleKey.isEmpty()) {
+        m_latestByKey.insert(staleKey, requestId);
+    }
+    return requestId;
+}
+
+bool AsyncDatabase::isStale(int requestId, const QString &staleKey)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_cancelled.contains(requestId)) {
+        return true;
+    }
+    return !staleKey.isEmpty() && m_latestByKey.value(staleKey) != requestId;
+}
+
+void AsyncDatabase::finishRequest(int requestId)
+{
+    m_callbacks.remove(requestId);
+    QMutexLocker locker(&m_mutex);
+    m_inFlight.remove(requestId);
+    m_cancelled.remove(requestId);
+}
+
+void AsyncDatabase::dispatch(const std::function<void(Database *)> &task, Access access)
+{
+    if (access == Read && m_readers) {
+        m_readers->run(task);
+        return;
+    }
+    QMetaObject::invokeMethod(m_writer, [this, task]() {
+        task(m_writer);
+    }, Qt::QueuedConnection);
+}
+
+int AsyncDatabase::submitScript(const QString &staleKey, const QJSValue &callback,
+                                std::function<QVariant(Database *)> job, Access access)
+{
+    return submitScript(registerRequest(staleKey), staleKey, callback, job, access);
+}
+
+int AsyncDatabase::submitCopy(const QString &filePath, const QJSValue &callback, Access access,
+                              std::function<bool(Database *, const QString &, const std::function<void(int, int)> &,
+                                                 const std::function<bool()> &)> copy)
+{
+    // Как и у выгрузки, идентификатор нужен самой задаче для прогресса и отмены
+    int requestId = registerRequest(QString());
+    return submitScript(requestId, QString(), callback, [this, requestId, filePath, copy](Database *db) {
+        bool success = copy(db, filePath, [this, requestId](int copied, int total) {
+            emit backupProgress(requestId, copied, total);
+        }, [this, requestId]() {
+            return isStale(requestId, QString());
+        });
+        return QVariant(success);
+    }, access);
+}
+
+int AsyncDatabase::submitScript(int requestId, const QString &staleKey, const QJSValue &callback,
+                                std::function<QVariant(Database *)> job, Access access)
+{
+    m_callbacks.insert(requestId, callback);
+    post<QVariant>(requestId, this, staleKey, job, [this, requestId](const QVariant &result) {
+        QJSValue callback = m_callbacks.value(requestId);
+        if (!callback.isCallable()) {
+            return;
+        }
+        QJSEngine *engine = qjsEngine(this);
+        QJSValue value = engine ? engine->toScriptValue(result) : QJSValue();
+        QJSValue returned = callback.call(QJSValueList{ value });
+        if (returned.isError()) {
+            qDebug() << "Async database callback error:" << returned.toString();
+        }
+    }, access);
+    return requestId;
+}
@@ -0,0 +1,162 @@
+#ifndef ASYNCDATABASE_H
+#define ASYNCDATABASE_H
+
+#include <QObject>
+#include <QThread>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QPointer>
+#include <QJSValue>
+#include <functional>
+#include <memory>
+#include "database.h"
+#include "readconnectionpool.h"
+
+// Асинхронный доступ к базе: чтение выполняется в пуле соединений только для чтения,
+// любая запись — в отдельном потоке через единственное пишущее соединение.
+// Результат возвращается в поток GUI через обратный вызов
+class AsyncDatabase : public QObject
+{
+    Q_OBJECT
+public:
+    enum Access {
+        Read,
+        Write
+    };
+
+    explicit AsyncDatabase(QObject *parent = nullptr);
+    ~AsyncDatabase();
+
+    // Пишущее соединение открывается и приводит схему к текущей версии до возврата,
+    // поэтому читающие соединения пула уже видят готовую схему
+    bool open(const QString &path, const DatabaseOptions &options = DatabaseOptions(),
+              int readConnections = DefaultReadConnections);
+
+    // Интерфейс для QML: callback получает результат соответствующего метода Database.
+    // Каждый метод возвращает идентификатор запроса для cancel().
+    Q_INVOKABLE int searchBooksAdvanced(const QString &searchTerm, int minYear, int maxYear, bool onlyAvailable,
+                                        const QString &author, const QString &genre, const QJSValue &callback);
+    Q_INVOKABLE int searchBooksRanked(const QString &searchTerm, int limit, const QJSValue &callback);
+    Q_INVOKABLE int facetCounts(const QString &searchTerm, int minYear, int maxYear, bool onlyAvailable,
+                                const QString &author, const QString &genre, int limit, const QJSValue &callback);
+    Q_INVOKABLE int getAllBooks(const QJSValue &callback);
+    Q_INVOKABLE int overdueLoans(int limit, const QJSValue &callback);
+    Q_INVOKABLE int readerLoanHistory(int readerId, int limit, const QJSValue &callback);
+    Q_INVOKABLE int loansPerDay(const QDateTime &from, const QDateTime &to, const QJSValue &callback);
+    Q_INVOKABLE int getAllReaders(const QJSValue &callback);
+    // format: "csv" или "jsonl"; ход выгрузки — сигнал exportProgress, прервать можно через cancel()
+    Q_INVOKABLE int exportBooks(const QString &filePath, const QString &format, const QJSValue &callback);
+    // Снимок снимается в пуле чтения и не мешает записи; восстановление идёт через пишущее соединение.
+    // Ход копирования — сигнал backupProgress, прервать можно через cancel()
+    Q_INVOKABLE int backupDatabase(const QString &filePath, const QJSValue &callback);
+    Q_INVOKABLE int restoreDatabase(const QString &filePath, const QJSValue &callback);
+    Q_INVOKABLE int compactDatabase(const QString &filePath, const QJSValue &callback);
+    Q_INVOKABLE int importBooksFromCSV(const QString &filePath, int batchSize, const QJSValue &callback);
+    Q_INVOKABLE int importReadersFromCSV(const QString &filePath, int batchSize, const QJSValue &callback);
+    // Изменения выполняются по очереди в потоке записи; callback получает результат (bool),
+    // а сигналы изменения строк приходят раньше него
+    Q_INVOKABLE int addBook(const QString &title, const QString &author, int year, const QString &genre,
+                            const QJSValue &callback);
+    Q_INVOKABLE int updateBook(int id, const QString &title, const QString &author, int year, const QString &genre,
+                               const QJSValue &callback);
+    Q_INVOKABLE int deleteBook(int id, const QJSValue &callback);
+    Q_INVOKABLE int addReader(const QString &name, const QString &contact, const QJSValue &callback);
+    Q_INVOKABLE int updateReader(int id, const QString &name, const QString &contact, const QJSValue &callback);
+    Q_INVOKABLE int deleteReader(int id, const QJSValue &callback);
+    Q_INVOKABLE int issueBook(int bookId, int readerId, const QJSValue &callback);
+    Q_INVOKABLE int issueBooks(int readerId, const QVariantList &bookIds, const QJSValue &callback);
+    Q_INVOKABLE int returnBook(int bookId, const QJSValue &callback);
+    Q_INVOKABLE void cancel(int requestId);
+
+    // Интерфейс для C++: job выполняется в потоке БД, done — в потоке GUI, если context ещё жив.
+    // Запросы с одинаковым непустым staleKey вытесняют друг друга: устаревший запрос
+    // не выполняется, если ещё не начат, и не доставляется, если уже выполнен.
+    template <typename Result>
+    int submit(QObject *context, const QString &staleKey,
+               std::function<Result(Database *)> job, std::function<void(const Result &)> done,
+               Access access = Read);
+
+    static const int DefaultReadConnections = 4;
+
+signals:
+    // Изменения строк, сделанные через пишущее соединение (включая импорт), в потоке GUI
+    void bookInserted(int bookId);
+    void bookUpdated(int bookId);
+    void bookDeleted(int bookId);
+    void loanChanged(int bookId);
+    void readerInserted(int readerId);
+    void readerUpdated(int readerId);
+    void readerDeleted(int readerId);
+    void importProgress(const QString &filePath, int rowsImported);
+    // Импорт сообщает об изменениях одним сигналом по завершении, а не построчно
+    void importFinished(const QString &filePath, bool success, int rowsImported);
+    void exportProgress(int requestId, qint64 rowsWritten, qint64 totalRows);
+    void backupProgress(int requestId, int copied, int total);
+    void databaseRestored();
+
+private:
+    int registerRequest(const QString &staleKey);
+    bool isStale(int requestId, const QString &staleKey);
+    void finishRequest(int requestId);
+    template <typename Result>
+    void post(int requestId, QObject *context, const QString &staleKey,
+              std::function<Result(Database *)> job, std::function<void(const Result &)> done, Access access);
+    int submitScript(const QString &staleKey, const QJSValue &callback, std::function<QVariant(Database *)> job,
+                     Access access = Read);
+    int submitCopy(const QString &filePath, const QJSValue &callback, Access access,
+                   std::function<bool(Database *, const QString &, const std::function<void(int, int)> &,
+                                      const std::function<bool()> &)> copy);
+    int submitScript(int requestId, const QString &staleKey, const QJSValue &callback,
+                     std::function<QVariant(Database *)> job, Access access);
+    void dispatch(const std::function<void(Database *)> &task, Access access);
+
+    QThread m_writerThread;
+    Database *m_writer;
+    std::unique_ptr<ReadConnectionPool> m_readers;
+
+    // Колбэки QML хранятся только в потоке GUI: QJSValue нельзя копировать в другом потоке
+    QHash<int, QJSValue> m_callbacks;
+
+    // Доступны из всех потоков
+    QMutex m_mutex;
+    int m_nextRequestId;
+    QHash<QString, int> m_latestByKey;
+    // Запросы от регистрации до finishRequest; отменить можно только их
+    QSet<int> m_inFlight;
+    QSet<int> m_cancelled;
+};
+
+template <typename Result>
+int AsyncDatabase::submit(QObject *context, const QString &staleKey,
+                          std::function<Result(Database *)> job, std::function<void(const Result &)> done,
+                          Access access)
+{
+    int requestId = registerRequest(staleKey);
+    post<Result>(requestId, context, staleKey, job, done, access);
+    return requestId;
+}
+
+template <typename Result>
+void AsyncDatabase::post(int requestId, QObject *context, const QString &staleKey,
+                         std::function<Result(Database *)> job, std::function<void(const Result &)> done,
+                         Access access)
+{
+    QPointer<QObject> guard(context);
+
+    dispatch([this, requestId, staleKey, job, done, guard](Database *db) {
+        // Устаревший запрос не выполняем, но всё равно сообщаем о завершении,
+        // чтобы поток GUI освободил связанные с ним данные
+        bool skipped = isStale(requestId, staleKey);
+        Result result = skipped ? Result() : job(db);
+
+        QMetaObject::invokeMethod(this, [this, requestId, staleKey, done, guard, skipped, result]() {
+            if (!skipped && guard && !isStale(requestId, staleKey)) {
+                done(result);
+            }
+            finishRequest(requestId);
+        }, Qt::QueuedConnection);
+    }, access);
+}
+
+#endif // ASYNCDATABASE_H
@@ -0,0 +1,371 @@
+// Нагрузочный замер методов Database на синтетическом каталоге.
+// Пример: laba77_bench --books 1000000 --iterations 500 --output result.json
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QVector>
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include "../database.h"
+#include "../querycache.h"
+
+namespace {
+
+const char *const titleWords[] = {
+    "война", "мир", "история", "тайна", "город", "море", "ночь", "сад", "дорога", "звезда",
+    "река", "дом", "время", "память", "огонь", "ветер", "север", "остров", "путь", "сердце",
+    "shadow", "garden", "empire", "winter", "signal", "harbor", "silver", "machine", "letter", "forest"
+};
+const char *const firstNames[] = {
+    "Анна", "Иван", "Мария", "Пётр", "Ольга", "Сергей", "Елена", "Алексей", "John", "Emily"
+};
+const char *const lastNames[] = {
+    "Иванов", "Смирнова", "Кузнецов", "Попова", "Соколов", "Лебедева", "Новиков", "Морозова", "Smith", "Brown"
+};
+const char *const genres[] = {
+    "роман", "детектив", "фантастика", "поэзия", "история", "наука", "драма", "приключения"
+};
+
+template <typename T, std::size_t N>
+const T &pick(const T (&values)[N], QRandomGenerator &random)
+{
+    return values[random.bounded(int(N))];
+}
+
+QString csvField(const QString &value)
+{
+    QString escaped = value;
+    escaped.replace('"', "\"\"");
+    return '"' + escaped + '"';
+}
+
+// Латентности одной операции и объём данных, который она обработала
+struct Measurement
+{
+    QString name;
+    QVector<qint64> nanoseconds;
+    qint64 rows = 0;
+};
+
+double percentileMs(QVector<qint64> sorted, double fraction)
+{
+    if (sorted.isEmpty()) {
+        return 0.0;
+    }
+    int index = qBound(0, int(fraction * sorted.size() + 0.5) - 1, int(sorted.size()) - 1);
+    return sorted.at(index) / 1e6;
+}
+
+QJsonObject toJson(const Measurement &measurement)
+{
+    QVector<qint64> sorted = measurement.nanoseconds;
+    std::sort(sorted.begin(), sorted.end());
+    qint64 total = 0;
+    for (qint64 value : sorted) {
+        total += value;
+    }
+
+    QJsonObject result;
+    result["operation"] = measurement.name;
+    result["iterations"] = sorted.size();
+    result["p50_ms"] = percentileMs(sorted, 0.50);
+    result["p99_ms"] = percentileMs(sorted, 0.99);
+    result["max_ms"] = sorted.isEmpty() ? 0.0 : sorted.last() / 1e6;
+    result["total_ms"] = total / 1e6;
+    result["rows"] = measurement.rows;
+    result["rows_per_s"] = total > 0 ? measurement.rows * 1e9 / total : 0.0;
+    return result;
+}
+
+// Выполняет operation iterations раз; operation возвращает число обработанных строк
+Measurement measure(const QString &name, int iterations, const std::function<qint64(int)> &operation)
+{
+    Measurement measurement;
+    measurement.name = name;
+    measurement.nanoseconds.reserve(iterations);
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i) {
+        timer.start();
+        measurement.rows += operation(i);
+        measurement.nanoseconds.append(timer.nsecsElapsed());
+    }
+    fprintf(stderr, "%s: %d iterations\n", qPrintable(name), iterations);
+    return measurement;
+}
+
+bool writeBooksCsv(const QString &path, qint64 count, QRandomGenerator &random)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        return false;
+    }
+    QTextStream out(&file);
+    out << "title,author,year,genre,available\n";
+    for (qint64 i = 0; i < count; ++i) {
+        QString title = QString::fromUtf8(pick(titleWords, random));
+        int words = 1 + random.bounded(3);
+        for (int w = 0; w < words; ++w) {
+            title += ' ' + QString::fromUtf8(pick(titleWords, random));
+        }
+        QString author = QString::fromUtf8(pick(firstNames, random)) + ' ' + QString::fromUtf8(pick(lastNames, random));
+        out << csvField(title) << ',' << csvField(author) << ',' << 1800 + random.bounded(225) << ','
+            << csvField(QString::fromUtf8(pick(genres, random))) << ",1\n";
+    }
+    return out.status() == QTextStream::Ok;
+}
+
+bool writeReadersCsv(const QString &path, qint64 count, QRandomGenerator &random)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        return false;
+    }
+    QTextStream out(&file);
+    out << "name,contact\n";
+    for (qint64 i = 0; i < count; ++i) {
+        QString name = QString::fromUtf8(pick(firstNames, random)) + ' ' + QString::fromUtf8(pick(lastNames, random));
+        out << csvField(name) << ",reader" << i << "@example.org\n";
+    }
+    return out.status() == QTextStream::Ok;
+}
+
+bool verbose = false;
+
+void messageHandler(QtMsgType type, const QMessageLogContext &, const QString &message)
+{
+    // Database пишет qDebug на каждый вызов: в замерах это был бы вывод в консоль, а не работа с базой
+    if (type == QtDebugMsg && !verbose) {
+        return;
+    }
+    fprintf(stderr, "%s\n", qPrintable(message));
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("laba77_bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Database benchmark on a synthetic library catalogue");
+    parser.addHelpOption();
+    QCommandLineOption booksOption("books", "Number of generated books.", "count", "10000");
+    QCommandLineOption readersOption("readers", "Number of generated readers (default: books / 10).", "count");
+    QCommandLineOption loansOption("loans", "Number of generated loans (default: books / 5).", "count");
+    QCommandLineOption iterationsOption("iterations", "Iterations per measured operation.", "count", "200");
+    QCommandLineOption seedOption("seed", "Random seed for the generator.", "seed", "1");
+    QCommandLineOption databaseOption("database", "Database file (default: temporary file).", "path");
+    QCommandLineOption forceOption("force", "Overwrite an existing --database file and its -wal/-shm files.");
+    QCommandLineOption outputOption("output", "Write the JSON report to a file instead of stdout.", "path");
+    QCommandLineOption cacheOption("cache", "Keep the query result cache enabled.");
+    QCommandLineOption skipOption("skip", "Comma-separated operations to skip (e.g. getAllBooks on huge catalogues).",
+                                  "operations");
+    QCommandLineOption verboseOption("verbose", "Show Database debug output.");
+    parser.addOptions({ booksOption, readersOption, loansOption, iterationsOption, seedOption,
+                        databaseOption, forceOption, outputOption, cacheOption, skipOption, verboseOption });
+    parser.process(app);
+
+    verbose = parser.isSet(verboseOption);
+    qInstallMessageHandler(messageHandler);
+
+    const qint64 bookCount = qMax<qint64>(1, parser.value(booksOption).toLongLong());
+    const qint64 readerCount = qMax<qint64>(1, parser.isSet(readersOption) ? parser.value(readersOption).toLongLong()
+                                                                           : bookCount / 10);
+    const qint64 loanCount = qMin(bookCount, parser.isSet(loansOption) ? parser.value(loansOption).toLongLong()
+                                                                       : bookCount / 5);
+    const int iterations = qMax(1, parser.value(iterationsOption).toInt());
+    QRandomGenerator random(parser.value(seedOption).toUInt());
+
+    QTemporaryDir workDir;
+    if (!workDir.isValid()) {
+        fprintf(stderr, "Cannot create temporary directory\n");
+        return 1;
+    }
+    QString databasePath = parser.isSet(databaseOption) ? parser.value(databaseOption)
+                                                        : workDir.filePath("bench.db");
+    // Замер начинается с пустой базы; чужой файл удаляется только по явному --force,
+    // вместе с журналом WAL и разделяемой памятью, иначе SQLite применил бы старый журнал
+    if (QFile::exists(databasePath)) {
+        if (!parser.isSet(forceOption)) {
+            fprintf(stderr, "Database %s already exists, use --force to overwrite it\n", qPrintable(databasePath));
+            return 1;
+        }
+        const QStringList files = { databasePath, databasePath + "-wal", databasePath + "-shm" };
+        for (const QString &path : files) {
+            if (QFile::exists(path) && !QFile::remove(path)) {
+                fprintf(stderr, "Cannot remove %s\n", qPrintable(path));
+                return 1;
+            }
+        }
+    }
+
+    // Повторяющиеся запросы иначе измеряли бы поиск в кэше, а не в базе
+    if (!parser.isSet(cacheOption)) {
+        QueryCache::forDatabase(databasePath, "library_bench").setMaxRows(0);
+    }
+
+    Database db;
+    if (!db.connectToDatabase(databasePath, "library_bench", DatabaseOptions())) {
+        fprintf(stderr, "Cannot open database %s\n", qPrintable(databasePath));
+        return 1;
+    }
+
+    QVector<Measurement> measurements;
+    const QStringList skipped = parser.value(skipOption).split(',', Qt::SkipEmptyParts);
+    auto run = [&](const QString &name, int count, const std::function<qint64(int)> &operation) {
+        if (!skipped.contains(name)) {
+            measurements.append(measure(name, count, operation));
+        }
+    };
+
+    // Заполнение: импорт CSV измеряется целиком как одна операция
+    QString booksCsv = workDir.filePath("books.csv");
+    QString readersCsv = workDir.filePath("readers.csv");
+    if (!writeBooksCsv(booksCsv, bookCount, random) || !writeReadersCsv(readersCsv, readerCount, random)) {
+        fprintf(stderr, "Cannot write generated CSV files\n");
+        return 1;
+    }
+    run("importBooksFromCSV", 1, [&](int) {
+        return db.importBooksFromCSV(booksCsv) ? bookCount : 0;
+    });
+    run("importReadersFromCSV", 1, [&](int) {
+        return db.importReadersFromCSV(readersCsv) ? readerCount : 0;
+    });
+
+    // Выдачи: книги с шагом по каталогу, пачками по пять одному читателю
+    const qint64 loanStep = loanCount > 0 ? bookCount / loanCount : 0;
+    const int loanBatch = 5;
+    const int loanCalls = int((loanCount + loanBatch - 1) / loanBatch);
+    run("issueBooks", loanCalls, [&](int call) {
+        QVariantList bookIds;
+        for (qint64 i = qint64(call) * loanBatch; i < qMin(loanCount, qint64(call + 1) * loanBatch); ++i) {
+            bookIds.append(1 + i * loanStep);
+        }
+        int readerId = 1 + int(random.bounded(quint32(readerCount)));
+        return db.issueBooks(readerId, bookIds) ? bookIds.size() : 0;
+    });
+
+    run("addBook", iterations, [&](int i) {
+        return db.addBook(QString("bench book %1").arg(i), "Bench Author", 2000, "bench") ? 1 : 0;
+    });
+    run("updateBook", iterations, [&](int i) {
+        int id = 1 + int(random.bounded(quint32(bookCount)));
+        return db.updateBook(id, QString("updated %1").arg(i), "Bench Author", 2001, "bench") ? 1 : 0;
+    });
+
+    // Книги из хвоста каталога не участвуют в выдачах при заполнении
+    const qint64 freeFirst = loanCount * qMax<qint64>(1, loanStep) + 1;
+    const qint64 freeCount = qMax<qint64>(1, bookCount - freeFirst + 1);
+    QVector<int> issued;
+    run("issueBook", iterations, [&](int i) {
+        int bookId = int(freeFirst + i % freeCount);
+        int readerId = 1 + int(random.bounded(quint32(readerCount)));
+        if (!db.issueBook(bookId, readerId)) {
+            return qint64(0);
+        }
+        issued.append(bookId);
+        return qint64(1);
+    });
+    run("returnBook", int(issued.size()), [&](int i) {
+        return db.returnBook(issued.at(i)) ? 1 : 0;
+    });
+
+    run("overdueLoans", iterations, [&](int) {
+        return qint64(db.overdueLoans().size());
+    });
+    run("readerLoanHistory", iterations, [&](int) {
+        return qint64(db.readerLoanHistory(1 + int(random.bounded(quint32(readerCount)))).size());
+    });
+    const QDateTime now = QDateTime::currentDateTime();
+    run("loansPerDay", iterations, [&](int) {
+        return qint64(db.loansPerDay(now.addDays(-365), now.addDays(1)).size());
+    });
+
+    run("getAllBooks", qMax(1, iterations / 20), [&](int) {
+        return db.getAllBooks().size();
+    });
+    run("searchBooks", iterations, [&](int) {
+        return db.searchBooks(QString::fromUtf8(pick(titleWords, random))).size();
+    });
+    run("searchBooksRanked", iterations, [&](int) {
+        return db.searchBooksRanked(QString::fromUtf8(pick(titleWords, random)), Database::DefaultPageSize).size();
+    });
+    run("searchBooksAdvanced", iterations, [&](int) {
+        int minYear = 1800 + random.bounded(200);
+        return db.searchBooksAdvanced(QString::fromUtf8(pick(titleWords, random)), minYear, minYear + 25, true,
+                                      QString(), QString::fromUtf8(pick(genres, random))).size();
+    });
+    run("countBooks", iterations, [&](int) {
+        db.countBooks(QString::fromUtf8(pick(titleWords, random)), 0, 0, false, QString(), QString());
+        return qint64(1);
+    });
+    run("facetCounts", iterations, [&](int) {
+        db.facetCounts(QString(), 0, 0, false, QString(), QString());
+        return qint64(1);
+    });
+    run("facetCountsFiltered", iterations, [&](int) {
+        int minYear = 1800 + random.bounded(200);
+        db.facetCounts(QString::fromUtf8(pick(titleWords, random)), minYear, minYear + 25, false, QString(), QString());
+        return qint64(1);
+    });
+
+    // Прокрутка списка: последовательные страницы keyset от начала каталога
+    QString afterTitle;
+    int afterId = 0;
+    run("getBooksPage", iterations, [&](int) {
+        QVariantList page = db.getBooksPage(afterTitle, afterId, Database::DefaultPageSize);
+        if (page.isEmpty()) {
+            afterTitle.clear();
+            afterId = 0;
+        } else {
+            QVariantMap last = page.last().toMap();
+            afterTitle = last["title"].toString();
+            afterId = last["id"].toInt();
+        }
+        return qint64(page.size());
+    });
+
+    const qint64 exportedRows = db.countBooksMatching(BookFilter());
+    run("exportToCSV", 1, [&](int) {
+        return db.exportToCSV(workDir.filePath("export.csv")) ? exportedRows : 0;
+    });
+    run("exportToJSONL", 1, [&](int) {
+        return db.exportToJSONL(workDir.filePath("export.jsonl")) ? exportedRows : 0;
+    });
+
+    QJsonArray operations;
+    for (const Measurement &measurement : measurements) {
+        operations.append(toJson(measurement));
+    }
+    QJsonObject report;
+    report["books"] = bookCount;
+    report["readers"] = readerCount;
+    report["loans"] = loanCount;
+    report["iterations"] = iterations;
+    report["seed"] = parser.value(seedOption);
+    report["cache"] = parser.isSet(cacheOption);
+    report["operations"] = operations;
+    QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+
+    if (parser.isSet(outputOption)) {
+        QFile output(parser.value(outputOption));
+        if (!output.open(QIODevice::WriteOnly) || output.write(json) != json.size()) {
+            fprintf(stderr, "Cannot write report to %s\n", qPrintable(parser.value(outputOption)));
+            return 1;
+        }
+    } else {
+        fwrite(json.constData(), 1, json.size(), stdout);
+    }
+
+    db.closeDatabase();
+    return 0;
+}
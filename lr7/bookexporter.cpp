@@ -0,0 +1,212 @@
+#include "bookexporter.h"
+#include <QDebug>
+#include <QSaveFile>
+#include <QSqlError>
+#include <QSqlRecord>
+
+BookExporter::BookExporter(Format format)
+    : m_format(format), m_progressInterval(10000), m_rowsWritten(0)
+{
+}
+
+void BookExporter::setProgressCallback(const std::function<void(qint64)> &progress, qint64 progressInterval)
+{
+    m_progress = progress;
+    m_progressInterval = qMax<qint64>(1, progressInterval);
+}
+
+void BookExporter::setCancelCheck(const std::function<bool()> &cancelled)
+{
+    m_cancelled = cancelled;
+}
+
+bool BookExporter::exportQuery(QSqlQuery &query, const QString &filePath)
+{
+    m_rowsWritten = 0;
+    m_errorString.clear();
+
+    // Индексы столбцов определяются один раз, а не поиском по имени в каждой ячейке
+    const QSqlRecord record = query.record();
+    const int idColumn = record.indexOf("id");
+    const int titleColumn = record.indexOf("title");
+    const int authorColumn = record.indexOf("author");
+    const int yearColumn = record.indexOf("year");
+    const int genreColumn = record.indexOf("genre");
+    const int availableColumn = record.indexOf("available");
+    const int readerColumn = record.indexOf("reader_name");
+    if (idColumn < 0 || titleColumn < 0 || authorColumn < 0 || yearColumn < 0
+        || genreColumn < 0 || availableColumn < 0 || readerColumn < 0) {
+        m_errorString = "Export query does not have the expected columns";
+        return false;
+    }
+
+    // QSaveFile подменяет целевой файл только при успешном commit()
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        m_errorString = "Cannot open file for writing: " + file.errorString();
+        return false;
+    }
+
+    m_buffer.clear();
+    m_buffer.reserve(WriteBufferSize + 4096);
+    if (m_format == Csv) {
+        m_buffer.append("ID,Title,Author,Year,Genre,Available,Reader\r\n");
+    }
+
+    while (query.next()) {
+        if (m_cancelled && m_cancelled()) {
+            file.cancelWriting();
+            m_errorString = "Export cancelled";
+            return false;
+        }
+
+        const bool available = query.value(availableColumn).toBool();
+        if (m_format == Csv) {
+            m_buffer.append(QByteArray::number(query.value(idColumn).toLongLong()));
+            m_buffer.append(',');
+            appendCsvField(query.value(titleColumn).toString());
+            m_buffer.append(',');
+            appendCsvField(query.value(authorColumn).toString());
+            m_buffer.append(',');
+            m_buffer.append(QByteArray::number(query.value(yearColumn).toInt()));
+            m_buffer.append(',');
+            appendCsvField(query.value(genreColumn).toString());
+            m_buffer.append(',');
+            m_buffer.append(available ? "Yes" : "No");
+            m_buffer.append(',');
+            appendCsvField(query.value(readerColumn).toString());
+            m_buffer.append("\r\n");
+        } else {
+            m_buffer.append("{\"id\":");
+            m_buffer.append(QByteArray::number(query.value(idColumn).toLongLong()));
+            m_buffer.append(",\"title\":");
+            appendJsonString(query.value(titleColumn).toString());
+            m_buffer.append(",\"author\":");
+            appendJsonString(query.value(authorColumn).toString());
+            m_buffer.append(",\"year\":");
+            m_buffer.append(QByteArray::number(query.value(yearColumn).toInt()));
+            m_buffer.append(",\"genre\":");
+            appendJsonString(query.value(genreColumn).toString());
+            m_buffer.append(",\"available\":");
+            m_buffer.append(available ? "true" : "false");
+            m_buffer.append(",\"reader_name\":");
+            if (query.isNull(readerColumn)) {
+                m_buffer.append("null");
+            } else {
+                appendJsonString(query.value(readerColumn).toString());
+            }
+            m_buffer.append("}\n");
+        }
+        ++m_rowsWritten;
+
+        if (m_buffer.size() >= WriteBufferSize) {
+            if (file.write(m_buffer) != m_buffer.size()) {
+                file.cancelWriting();
+                m_errorString = "Write error: " + file.errorString();
+                return false;
+            }
+            m_buffer.clear();
+        }
+        if (m_progress && m_rowsWritten % m_progressInterval == 0) {
+            m_progress(m_rowsWritten);
+        }
+    }
+
+    if (query.lastError().isValid()) {
+        file.cancelWriting();
+        m_errorString = "Query error: " + query.lastError().text();
+        return false;
+    }
+    if (file.write(m_buffer) != m_buffer.size() || !file.commit()) {
+        m_errorString = "Write error: " + file.errorString();
+        return false;
+    }
+    m_buffer.clear();
+    m_buffer.squeeze();
+
+    if (m_progress) {
+        m_progress(m_rowsWritten);
+    }
+    return true;
+}
+
+qint64 BookExporter::rowsWritten() const
+{
+    return m_rowsWritten;
+}
+
+QString BookExporter::errorString() const
+{
+    return m_errorString;
+}
+
+BookExporter::Format BookExporter::formatFromName(const QString &name)
+{
+    QString normalized = name.toLower();
+    return (normalized == "jsonl" || normalized == "json") ? JsonLines : Csv;
+}
+
+void BookExporter::appendCsvField(const QString &value)
+{
+    // RFC 4180: поле в кавычках, если содержит разделитель, кавычку или перевод строки;
+    // кавычки внутри удваиваются
+    const QByteArray utf8 = value.toUtf8();
+    bool needsQuotes = false;
+    for (char c : utf8) {
+        if (c == ',' || c == '"' || c == '\r' || c == '\n') {
+            needsQuotes = true;
+            break;
+        }
+    }
+    if (!needsQuotes) {
+        m_buffer.append(utf8);
+        return;
+    }
+
+    m_buffer.append('"');
+    for (char c : utf8) {
+        if (c == '"') {
+            m_buffer.append('"');
+        }
+        m_buffer.append(c);
+    }
+    m_buffer.append('"');
+}
+
+void BookExporter::appendJsonString(const QString &value)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    const QByteArray utf8 = value.toUtf8();
+    m_buffer.append('"');
+    for (char c : utf8) {
+        const unsigned char byte = static_cast<unsigned char>(c);
+        switch (c) {
+        case '"':
+            m_buffer.append("\\\"");
+            break;
+        case '\\':
+            m_buffer.append("\\\\");
+            break;
+        case '\n':
+            m_buffer.append("\\n");
+            break;
+        case '\r':
+            m_buffer.append("\\r");
+            break;
+        case '\t':
+            m_buffer.append("\\t");
+            break;
+        default:
+            // Байты UTF-8 выше 0x7F допустимы в JSON как есть, управляющие символы экранируются
+            if (byte < 0x20) {
+                m_buffer.append("\\u00");
+                m_buffer.append(hexDigits[byte >> 4]);
+                m_buffer.append(hexDigits[byte & 0xF]);
+            } else {
+                m_buffer.append(c);
+            }
+            break;
+        }
+    }
+    m_buffer.append('"');
+}
@@ -0,0 +1,50 @@
+#ifndef BOOKEXPORTER_H
+#define BOOKEXPORTER_H
+
+#include <QByteArray>
+#include <QSqlQuery>
+#include <QString>
+#include <functional>
+
+// Потоковая выгрузка результата запроса книг в CSV (RFC 4180) или JSON Lines.
+// Память постоянна: строки читаются однонаправленным курсором и копятся в буфере,
+// который сбрасывается в файл крупными блоками.
+class BookExporter
+{
+public:
+    enum Format {
+        Csv,
+        JsonLines
+    };
+
+    explicit BookExporter(Format format);
+
+    // Вызывается из потока выгрузки каждые progressInterval строк и по завершении
+    void setProgressCallback(const std::function<void(qint64 rowsWritten)> &progress, qint64 progressInterval = 10000);
+    // Проверяется между строками; при отмене файл не создаётся
+    void setCancelCheck(const std::function<bool()> &cancelled);
+
+    // Ожидает столбцы id, title, author, year, genre, available, reader_name
+    bool exportQuery(QSqlQuery &query, const QString &filePath);
+
+    qint64 rowsWritten() const;
+    QString errorString() const;
+
+    static Format formatFromName(const QString &name);
+
+    static const int WriteBufferSize = 1024 * 1024;
+
+private:
+    void appendCsvField(const QString &value);
+    void appendJsonString(const QString &value);
+
+    Format m_format;
+    std::function<void(qint64)> m_progress;
+    qint64 m_progressInterval;
+    std::function<bool()> m_cancelled;
+    QByteArray m_buffer;
+    qint64 m_rowsWritten;
+    QString m_errorString;
+};
+
+#endif // BOOKEXPORTER_H
@@ -0,0 +1,106 @@
+#include "bookmodel.h"
+
+BookModel::BookModel(AsyncDatabase *database, QObject *parent)
+    : KeysetListModel(database, "bookModel", parent)
+{
+}
+
+QVariant BookModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= rows().size()) {
+        return QVariant();
+    }
+
+    const Book &row = rows().at(index.row());
+    switch (role) {
+    case IdRole:
+        return row.id;
+    case Qt::DisplayRole:
+    case TitleRole:
+        return row.title;
+    case AuthorRole:
+        return row.author;
+    case YearRole:
+        return row.year;
+    case GenreRole:
+        return row.genre;
+    case AvailableRole:
+        return row.available;
+    case ReaderNameRole:
+        return row.readerName;
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> BookModel::roleNames() const
+{
+    return {
+        { IdRole, "id" },
+        { TitleRole, "title" },
+        { AuthorRole, "author" },
+        { YearRole, "year" },
+        { GenreRole, "genre" },
+        { AvailableRole, "available" },
+        { ReaderNameRole, "reader_name" }
+    };
+}
+
+BookModel::Query BookModel::pageQuery(const QString &afterTitle, int afterId, bool withCount) const
+{
+    BookFilter filter = m_filter;
+    return [filter, afterTitle, afterId, withCount](Database *db) {
+        Page page;
+        if (withCount) {
+            page.totalCount = db->countBooksMatching(filter);
+        }
+        QSqlQuery query = db->queryBooksPage(filter, afterTitle, afterId, Database::DefaultPageSize);
+        page.rows = Database::readBooks(query);
+        return page;
+    };
+}
+
+BookModel::Query BookModel::refreshQuery(const QVector<int> &ids, bool withCount) const
+{
+    BookFilter filter = m_filter;
+    return [filter, ids, withCount](Database *db) {
+        Page refresh;
+        if (withCount) {
+            refresh.totalCount = db->countBooksMatching(filter);
+        }
+        QSqlQuery query = db->queryBooksById(filter, ids);
+        refresh.rows = Database::readBooks(query);
+        return refresh;
+    };
+}
+
+void BookModel::setFilter(const QString &searchTerm, int minYear, int maxYear, bool onlyAvailable,
+                          const QString &author, const QString &genre)
+{
+    m_filter.searchTerm = searchTerm;
+    m_filter.fullText = true;
+    m_filter.minYear = minYear;
+    m_filter.maxYear = maxYear;
+    m_filter.onlyAvailable = onlyAvailable;
+    m_filter.author = author;
+    m_filter.genre = genre;
+    reload();
+}
+
+void BookModel::onBookInserted(int bookId)
+{
+    // Новой книги не было ни в списке, ни в totalCount
+    markChanged(bookId, 0);
+}
+
+void BookModel::onBookChanged(int bookId)
+{
+    // Книга за пределами недогруженного списка может проходить фильтр, а может и нет
+    int countedBefore = -1;
+    if (indexOfId(bookId) >= 0) {
+        countedBefore = 1;
+    } else if (m_exhausted) {
+        countedBefore = 0;
+    }
+    markChanged(bookId, countedBefore);
+}
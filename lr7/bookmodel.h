@@ -0,0 +1,42 @@
+#ifndef BOOKMODEL_H
+#define BOOKMODEL_H
+
+#include "keysetmodel.h"
+
+// Модель списка книг для ListView с фильтром каталога
+class BookModel : public KeysetListModel<Book, &Book::title>
+{
+    Q_OBJECT
+public:
+    enum Roles {
+        IdRole = Qt::UserRole + 1,
+        TitleRole,
+        AuthorRole,
+        YearRole,
+        GenreRole,
+        AvailableRole,
+        ReaderNameRole
+    };
+
+    explicit BookModel(AsyncDatabase *database, QObject *parent = nullptr);
+
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    // Строка поиска ищется по началам слов через полнотекстовый индекс (BookFilter::fullText)
+    Q_INVOKABLE void setFilter(const QString &searchTerm, int minYear, int maxYear, bool onlyAvailable,
+                               const QString &author, const QString &genre);
+
+    // Точечное обновление после изменения книги в базе (подключаются к сигналам Database):
+    // перечитываются только изменённые строки, загруженный список не сбрасывается
+    void onBookInserted(int bookId);
+    void onBookChanged(int bookId);
+
+private:
+    Query pageQuery(const QString &afterTitle, int afterId, bool withCount) const override;
+    Query refreshQuery(const QVector<int> &ids, bool withCount) const override;
+
+    BookFilter m_filter;
+};
+
+#endif // BOOKMODEL_H
@@ -1,11 +1,560 @@
 #include "database.h"
+#include "querycache.h"
 #include <QDebug>
 #include <QStandardPaths>
 #include <QFile>
 #include <QTextStream>
 #include <QDateTime>
+#include <QRegularExpression>
+#include <QVector>
+#include <QFileInfo>
+#include <QSqlRecord>
+#include <limits>
 
-Database::Database(QObject *parent) : QObject(parent)
+#ifdef LABA77_SQLITE_BACKUP_API
+#include <QSqlDriver>
+#include <sqlite3.h>
+#endif
+
+namespace {
+
+// Шаг миграции схемы: применяется один раз, когда PRAGMA user_version меньше version
+struct Migration
+{
+    int version;
+    const char *description;
+    QStringList statements;
+    // Шаг зависит от возможностей сборки SQLite: если он не применился, версия всё равно
+    // повышается, а приложение работает без него
+    bool optional = false;
+};
+
+// Срез каталога для сводных счётчиков. В expression вместо %1 подставляется префикс строки
+// (new., old. или b.), column — столбец books, от которого зависит значение
+struct Facet
+{
+    const char *name;
+    const char *column;
+    const char *expression;
+    // Десятилетия показываются по порядку, остальные срезы — по убыванию числа книг
+    bool orderByValue;
+};
+
+// Состав срезов входит в миграцию 4: новый срез добавляется отдельной миграцией
+const QVector<Facet> &bookFacets()
+{
+    static const QVector<Facet> facets = {
+        { "genre", "genre", "COALESCE(%1genre, '')", false },
+        { "author", "author", "COALESCE(%1author, '')", false },
+        { "decade", "year", "COALESCE(%1year, 0) / 10 * 10", true },
+        { "available", "available", "(COALESCE(%1available, 0) != 0)", false }
+    };
+    return facets;
+}
+
+QString facetIncrement(const Facet &facet, const QString &row)
+{
+    return QString("INSERT INTO book_facets (facet, value, count) VALUES ('%1', %2, 1) "
+                   "ON CONFLICT (facet, value) DO UPDATE SET count = count + 1; ")
+        .arg(facet.name, QString(facet.expression).arg(row));
+}
+
+QString facetDecrement(const Facet &facet, const QString &row)
+{
+    // Опустевшее значение удаляется, чтобы в сводке не копились нулевые строки
+    QString key = QString("facet = '%1' AND value = %2").arg(facet.name, QString(facet.expression).arg(row));
+    return "UPDATE book_facets SET count = count - 1 WHERE " + key + "; "
+           "DELETE FROM book_facets WHERE " + key + " AND count <= 0; ";
+}
+
+// Сводная таблица и триггеры, которые поддерживают её при любых изменениях books
+QStringList facetSummaryStatements()
+{
+    QStringList statements;
+    statements.append("CREATE TABLE IF NOT EXISTS book_facets ("
+                      "facet TEXT NOT NULL, "
+                      "value NOT NULL, "
+                      "count INTEGER NOT NULL, "
+                      "PRIMARY KEY (facet, value)) WITHOUT ROWID");
+
+    QString onInsert;
+    QString onDelete;
+    for (const Facet &facet : bookFacets()) {
+        onInsert += facetIncrement(facet, "new.");
+        onDelete += facetDecrement(facet, "old.");
+        statements.append(QString("INSERT INTO book_facets (facet, value, count) "
+                                  "SELECT '%1', %2 AS value, COUNT(*) FROM books GROUP BY value")
+                              .arg(facet.name, QString(facet.expression).arg(QString())));
+        // Выдача и возврат меняют только available: остальные срезы при этом не трогаются
+        statements.append(QString("CREATE TRIGGER IF NOT EXISTS book_facets_au_%1 AFTER UPDATE OF %2 ON books "
+                                  "WHEN %3 IS NOT %4 BEGIN ")
+                              .arg(facet.name, facet.column, QString(facet.expression).arg("old."),
+                                   QString(facet.expression).arg("new."))
+                          + facetDecrement(facet, "old.") + facetIncrement(facet, "new.") + "END");
+    }
+    statements.append("CREATE TRIGGER IF NOT EXISTS book_facets_ai AFTER INSERT ON books BEGIN " + onInsert + "END");
+    statements.append("CREATE TRIGGER IF NOT EXISTS book_facets_ad AFTER DELETE ON books BEGIN " + onDelete + "END");
+    return statements;
+}
+
+// Новые изменения схемы добавляются только в конец списка, уже выпущенные шаги не редактируются
+const QVector<Migration> &schemaMigrations()
+{
+    static const QVector<Migration> migrations = {
+        { 1, "base tables", {
+            "CREATE TABLE IF NOT EXISTS books ("
+            "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+            "title TEXT, "
+            "author TEXT, "
+            "year INTEGER, "
+            "genre TEXT, "
+            "available BOOLEAN)",
+            "CREATE TABLE IF NOT EXISTS readers ("
+            "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+            "name TEXT, "
+            "contact TEXT)",
+            "CREATE TABLE IF NOT EXISTS loans ("
+            "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+            "book_id INTEGER, "
+            "reader_id INTEGER, "
+            "issue_date TEXT)"
+        } },
+        { 2, "indexes for joins, deletes and sorted listings", {
+            "CREATE INDEX IF NOT EXISTS idx_loans_book_id ON loans(book_id)",
+            "CREATE INDEX IF NOT EXISTS idx_loans_reader_id ON loans(reader_id)",
+            // rowid (id) неявно входит в индекс, поэтому он же обслуживает keyset по (title, id)
+            "CREATE INDEX IF NOT EXISTS idx_books_title ON books(title)",
+            "CREATE INDEX IF NOT EXISTS idx_books_year ON books(year)",
+            "CREATE INDEX IF NOT EXISTS idx_readers_name ON readers(name)",
+            "ANALYZE"
+        } },
+        { 3, "at most one open loan per book", {
+            // Прежняя неатомарная выдача могла оставить несколько записей на одну книгу:
+            // оставляем последнюю. Доступна ровно та книга, на которую нет выдачи, иначе
+            // книгу без выдачи с available = 0 нельзя было бы ни выдать, ни вернуть
+            "DELETE FROM loans WHERE id NOT IN (SELECT MAX(id) FROM loans GROUP BY book_id)",
+            "UPDATE books SET available = (id NOT IN (SELECT book_id FROM loans WHERE book_id IS NOT NULL))",
+            "DROP INDEX IF EXISTS idx_loans_book_id",
+            "CREATE UNIQUE INDEX IF NOT EXISTS idx_loans_book_id_unique ON loans(book_id)"
+        } },
+        { 4, "facet summary counts maintained by triggers", facetSummaryStatements() },
+        { 5, "epoch loan dates and append-only loan history", {
+            // Текстовая issue_date остаётся для совместимости, но выборки по времени идут по целым секундам
+            "ALTER TABLE loans ADD COLUMN issued_at INTEGER",
+            "ALTER TABLE loans ADD COLUMN due_at INTEGER",
+            // issue_date записывалась как местное время без смещения (Qt::ISODate): модификатор
+            // utc переводит её в UTC, иначе strftime('%s') сдвинула бы время на смещение пояса
+            "UPDATE loans SET issued_at = COALESCE(CAST(strftime('%s', issue_date, 'utc') AS INTEGER), "
+            "CAST(strftime('%s', 'now') AS INTEGER))",
+            // Тот же срок, что у новой выдачи по умолчанию
+            QString("UPDATE loans SET due_at = issued_at + %1")
+                .arg(qint64(Database::DefaultLoanDays) * Database::SecondsPerDay),
+            "CREATE INDEX IF NOT EXISTS idx_loans_due_at ON loans(due_at)",
+            // Строка истории не удаляется ни при возврате, ни при удалении книги или читателя:
+            // единственное изменение — однократная отметка returned_at
+            "CREATE TABLE IF NOT EXISTS loan_history ("
+            "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+            "book_id INTEGER NOT NULL, "
+            "reader_id INTEGER NOT NULL, "
+            "issued_at INTEGER NOT NULL, "
+            "due_at INTEGER NOT NULL, "
+            "returned_at INTEGER)",
+            "INSERT INTO loan_history (book_id, reader_id, issued_at, due_at) "
+            "SELECT book_id, reader_id, issued_at, due_at FROM loans",
+            "CREATE INDEX IF NOT EXISTS idx_loan_history_issued_at ON loan_history(issued_at)",
+            "CREATE INDEX IF NOT EXISTS idx_loan_history_reader ON loan_history(reader_id, issued_at)",
+            "CREATE INDEX IF NOT EXISTS idx_loan_history_open ON loan_history(book_id) WHERE returned_at IS NULL",
+            // Любое закрытие выдачи (возврат, удаление книги или читателя) проходит через DELETE FROM loans
+            "CREATE TRIGGER IF NOT EXISTS loan_history_ai AFTER INSERT ON loans BEGIN "
+            "INSERT INTO loan_history (book_id, reader_id, issued_at, due_at) "
+            "VALUES (new.book_id, new.reader_id, new.issued_at, new.due_at); "
+            "END",
+            "CREATE TRIGGER IF NOT EXISTS loan_history_ad AFTER DELETE ON loans BEGIN "
+            "UPDATE loan_history SET returned_at = CAST(strftime('%s', 'now') AS INTEGER) "
+            "WHERE book_id = old.book_id AND returned_at IS NULL; "
+            "END"
+        } },
+        { 6, "keyset indexes that treat NULL titles and names as empty strings", {
+            // Сравнение (title, id) > (...) с NULL не истинно никогда, поэтому ключ постраничной
+            // выборки — COALESCE(title, ''); выражение индекса должно совпадать с ORDER BY
+            "CREATE INDEX IF NOT EXISTS idx_books_title_key ON books(COALESCE(title, ''))",
+            "CREATE INDEX IF NOT EXISTS idx_readers_name_key ON readers(COALESCE(name, ''))",
+            // Индексы по самим столбцам из миграции 2 больше не обслуживают ни одного запроса
+            "DROP INDEX IF EXISTS idx_books_title",
+            "DROP INDEX IF EXISTS idx_readers_name"
+        } },
+        { 7, "full-text index for ranked search", {
+            // Внешнее содержимое: индекс хранит только токены, сами строки остаются в books
+            "CREATE VIRTUAL TABLE IF NOT EXISTS books_fts USING fts5("
+            "title, author, genre, "
+            "content='books', content_rowid='id', "
+            "tokenize='unicode61 remove_diacritics 2')",
+            // Триггеры поддерживают индекс в актуальном состоянии при любых изменениях books
+            "CREATE TRIGGER IF NOT EXISTS books_fts_ai AFTER INSERT ON books BEGIN "
+            "INSERT INTO books_fts(rowid, title, author, genre) "
+            "VALUES (new.id, new.title, new.author, new.genre); "
+            "END",
+            "CREATE TRIGGER IF NOT EXISTS books_fts_ad AFTER DELETE ON books BEGIN "
+            "INSERT INTO books_fts(books_fts, rowid, title, author, genre) "
+            "VALUES ('delete', old.id, old.title, old.author, old.genre); "
+            "END",
+            "CREATE TRIGGER IF NOT EXISTS books_fts_au AFTER UPDATE OF title, author, genre ON books BEGIN "
+            "INSERT INTO books_fts(books_fts, rowid, title, author, genre) "
+            "VALUES ('delete', old.id, old.title, old.author, old.genre); "
+            "INSERT INTO books_fts(rowid, title, author, genre) "
+            "VALUES (new.id, new.title, new.author, new.genre); "
+            "END",
+            "INSERT INTO books_fts(books_fts) VALUES ('rebuild')"
+        }, true }
+    };
+    return migrations;
+}
+
+// Чтение одной записи CSV (RFC 4180): поля в кавычках могут содержать запятые,
+// удвоенные кавычки и переводы строк
+bool readCsvRecord(QTextStream &in, QStringList &fields)
+{
+    fields.clear();
+    if (in.atEnd()) {
+        return false;
+    }
+
+    QString field;
+    bool inQuotes = false;
+    QString line = in.readLine();
+    while (true) {
+        for (int i = 0; i < line.size(); ++i) {
+            QChar c = line.at(i);
+            if (inQuotes) {
+                if (c == '"') {
+                    if (i + 1 < line.size() && line.at(i + 1) == '"') {
+                        field += '"';
+                        ++i;
+                    } else {
+                        inQuotes = false;
+                    }
+                } else {
+                    field += c;
+                }
+            } else if (c == '"') {
+                inQuotes = true;
+            } else if (c == ',') {
+                fields.append(field);
+                field.clear();
+            } else {
+                field += c;
+            }
+        }
+        if (!inQuotes || in.atEnd()) {
+            break;
+        }
+        field += '\n';
+        line = in.readLine();
+    }
+    fields.append(field);
+    return true;
+}
+
+#ifdef LABA77_SQLITE_BACKUP_API
+// Пауза перед повтором шага копирования, если база занята другим соединением
+const int BackupRetryMs = 50;
+
+// Handle драйвера QSQLITE; годится для вызовов sqlite3_*, только если Qt собран с той же
+// системной библиотекой SQLite, с которой собрано приложение
+sqlite3 *nativeHandle(const QSqlDatabase &db)
+{
+    QVariant handle = db.driver()->handle();
+    if (!handle.isValid() || qstrcmp(handle.typeName(), "sqlite3*") != 0) {
+        return nullptr;
+    }
+    return *static_cast<sqlite3 *const *>(handle.constData());
+}
+
+// Копирует базу main из source в destination порциями по pagesPerStep страниц.
+// Блокировка источника держится только на время шага, поэтому запись между шагами не ждёт;
+// если источник изменило другое соединение, SQLite сам начинает копирование заново
+bool copyPages(sqlite3 *destination, sqlite3 *source, int pagesPerStep,
+               const std::function<void(int, int)> &progress, const std::function<bool()> &cancelled,
+               QString &error)
+{
+    sqlite3_backup *backup = sqlite3_backup_init(destination, "main", source, "main");
+    if (!backup) {
+        error = QString::fromUtf8(sqlite3_errmsg(destination));
+        return false;
+    }
+
+    int rc;
+    do {
+        rc = sqlite3_backup_step(backup, pagesPerStep > 0 ? pagesPerStep : -1);
+        if (progress) {
+            int pageCount = sqlite3_backup_pagecount(backup);
+            progress(pageCount - sqlite3_backup_remaining(backup), pageCount);
+        }
+        if (cancelled && cancelled()) {
+            // Незавершённое копирование откатывается: приёмник остаётся прежним
+            sqlite3_backup_finish(backup);
+            error = "cancelled";
+            return false;
+        }
+        if (rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+            sqlite3_sleep(BackupRetryMs);
+        }
+    } while (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED);
+
+    if (sqlite3_backup_finish(backup) != SQLITE_OK) {
+        error = QString::fromUtf8(sqlite3_errmsg(destination));
+        return false;
+    }
+    return true;
+}
+#else
+// Объект схемы в порядке создания: таблица, индекс, триггер или представление
+struct SchemaObject
+{
+    QString type;
+    QString name;
+    QString sql;
+};
+
+QString quotedName(const QString &name)
+{
+    return '"' + QString(name).replace('"', "\"\"") + '"';
+}
+
+bool execStatement(QSqlQuery &query, const QString &sql, QString &error)
+{
+    if (!query.exec(sql)) {
+        error = query.lastError().text() + " in: " + sql;
+        return false;
+    }
+    return true;
+}
+
+// Пользовательские объекты схемы schema, удовлетворяющие условию filter; служебные таблицы
+// sqlite_* и автоматические индексы (без текста SQL) не входят
+bool readSchemaObjects(QSqlQuery &query, const QString &schema, const QString &filter,
+                       QVector<SchemaObject> &objects, QString &error)
+{
+    objects.clear();
+    if (!execStatement(query, QString("SELECT type, name, sql FROM %1.sqlite_master "
+                                      "WHERE name NOT LIKE 'sqlite\\_%' ESCAPE '\\' AND sql IS NOT NULL AND (%2) "
+                                      "ORDER BY rowid").arg(quotedName(schema), filter), error)) {
+        return false;
+    }
+    while (query.next()) {
+        objects.append({ query.value(0).toString(), query.value(1).toString(), query.value(2).toString() });
+    }
+    return true;
+}
+
+bool hasTable(QSqlQuery &query, const QString &schema, const QString &table)
+{
+    query.prepare(QString("SELECT 1 FROM %1.sqlite_master WHERE type = 'table' AND name = :name")
+                      .arg(quotedName(schema)));
+    query.bindValue(":name", table);
+    return query.exec() && query.next();
+}
+
+void reportRows(const std::function<void(int, int)> &progress, qint64 rowsCopied, qint64 rowCount)
+{
+    if (progress) {
+        progress(int(qMin<qint64>(rowsCopied, std::numeric_limits<int>::max())),
+                 int(qMin<qint64>(rowCount, std::numeric_limits<int>::max())));
+    }
+}
+
+// Копирует одну таблицу from.table в main порциями по rowsPerStep строк в порядке rowid.
+// Граница порции берётся из источника, поэтому годится и для таблиц без INTEGER PRIMARY KEY
+bool copyTableRows(QSqlDatabase &db, const QString &from, const SchemaObject &table, int rowsPerStep,
+                   qint64 &rowsCopied, qint64 rowCount, const std::function<void(int, int)> &progress,
+                   const std::function<bool()> &cancelled, QString &error)
+{
+    static const QRegularExpression withoutRowid("WITHOUT\\s+ROWID\\s*$", QRegularExpression::CaseInsensitiveOption);
+    const QString source = quotedName(from) + "." + quotedName(table.name);
+    const QString insert = "INSERT INTO main." + quotedName(table.name) + " SELECT * FROM " + source;
+    QSqlQuery query(db);
+
+    // Таблицы WITHOUT ROWID здесь — сводные счётчики: они невелики и копируются одним запросом
+    if (withoutRowid.match(table.sql).hasMatch()) {
+        if (!execStatement(query, insert, error)) {
+            return false;
+        }
+        rowsCopied += qMax(query.numRowsAffected(), 0);
+        reportRows(progress, rowsCopied, rowCount);
+        return true;
+    }
+
+    QSqlQuery boundQuery(db);
+    qint64 lower = std::numeric_limits<qint64>::min();
+    while (true) {
+        // Первая строка следующей порции; если её нет, текущая порция — последняя
+        boundQuery.prepare("SELECT rowid FROM " + source + " WHERE rowid >= :lower ORDER BY rowid LIMIT 1 OFFSET :step");
+        boundQuery.bindValue(":lower", lower);
+        boundQuery.bindValue(":step", qMax(rowsPerStep, 1));
+        if (!boundQuery.exec()) {
+            error = boundQuery.lastError().text();
+            return false;
+        }
+        const bool last = !boundQuery.next();
+        const qint64 upper = last ? 0 : boundQuery.value(0).toLongLong();
+        boundQuery.finish();
+
+        query.prepare(insert + " WHERE rowid >= :lower" + (last ? QString() : QString(" AND rowid < :upper")));
+        query.bindValue(":lower", lower);
+        if (!last) {
+            query.bindValue(":upper", upper);
+        }
+        if (!query.exec()) {
+            error = query.lastError().text();
+            return false;
+        }
+        rowsCopied += qMax(query.numRowsAffected(), 0);
+        reportRows(progress, rowsCopied, rowCount);
+        if (cancelled && cancelled()) {
+            error = "cancelled";
+            return false;
+        }
+        if (last) {
+            return true;
+        }
+        lower = upper;
+    }
+}
+
+// Заменяет схему и данные main копией присоединённой базы from. Вызывается внутри транзакции
+bool replaceMainWith(QSqlDatabase &db, const QString &from, int rowsPerStep,
+                     const std::function<void(int, int)> &progress, const std::function<bool()> &cancelled,
+                     QString &error)
+{
+    QSqlQuery query(db);
+    QVector<SchemaObject> objects;
+
+    // Прежнее содержимое main: сначала триггеры и представления, затем виртуальные таблицы
+    // вместе со служебными, затем остальные таблицы вместе с их индексами
+    const QStringList dropOrder = { "type IN ('trigger', 'view')",
+                                    "type = 'table' AND sql LIKE 'CREATE VIRTUAL TABLE%'",
+                                    "type = 'table'" };
+    for (const QString &filter : dropOrder) {
+        if (!readSchemaObjects(query, "main", filter, objects, error)) {
+            return false;
+        }
+        for (const SchemaObject &object : objects) {
+            if (!execStatement(query, QString("DROP %1 IF EXISTS main.%2").arg(object.type.toUpper(),
+                                                                             quotedName(object.name)), error)) {
+                return false;
+            }
+        }
+    }
+
+    // Виртуальные таблицы создаются первыми: они сами заводят свои служебные таблицы, содержимое
+    // которых затем копируется как у обычных, так что полнотекстовый индекс не перестраивается
+    QVector<SchemaObject> tables;
+    QStringList virtualTables;
+    if (!readSchemaObjects(query, from, "type = 'table'", tables, error)) {
+        return false;
+    }
+    for (const SchemaObject &table : tables) {
+        if (table.sql.startsWith("CREATE VIRTUAL TABLE", Qt::CaseInsensitive)) {
+            virtualTables.append(table.name);
+            if (!execStatement(query, table.sql, error)) {
+                return false;
+            }
+        }
+    }
+
+    QVector<SchemaObject> dataTables;
+    qint64 rowCount = 0;
+    for (const SchemaObject &table : tables) {
+        if (virtualTables.contains(table.name)) {
+            continue;
+        }
+        bool shadow = false;
+        for (const QString &virtualTable : virtualTables) {
+            shadow = shadow || table.name.startsWith(virtualTable + "_");
+        }
+        // Служебные таблицы уже созданы вместе с виртуальной, но со своим начальным содержимым
+        if (!execStatement(query, shadow ? "DELETE FROM main." + quotedName(table.name) : table.sql, error)) {
+            return false;
+        }
+        if (!execStatement(query, "SELECT COUNT(*) FROM " + quotedName(from) + "." + quotedName(table.name), error)
+            || !query.next()) {
+            return false;
+        }
+        rowCount += query.value(0).toLongLong();
+        dataTables.append(table);
+    }
+
+    // Индексы и триггеры создаются после данных: индекс строится один раз, а триггеры
+    // (счётчики, история выдач, полнотекстовый индекс) не срабатывают на копируемых строках
+    qint64 rowsCopied = 0;
+    for (const SchemaObject &table : dataTables) {
+        if (!copyTableRows(db, from, table, rowsPerStep, rowsCopied, rowCount, progress, cancelled, error)) {
+            return false;
+        }
+    }
+
+    // Счётчики AUTOINCREMENT и статистика планировщика живут в служебных таблицах, которые
+    // не удаляются вместе с остальными. sqlite_stat1 нельзя создать напрямую: её заводит ANALYZE
+    for (const QString &table : { QStringLiteral("sqlite_sequence"), QStringLiteral("sqlite_stat1") }) {
+        if (hasTable(query, "main", table)
+            && !execStatement(query, "DELETE FROM main." + table, error)) {
+            return false;
+        }
+        if (!hasTable(query, from, table)) {
+            continue;
+        }
+        if ((table == "sqlite_stat1" && !hasTable(query, "main", table)
+             && (!execStatement(query, "ANALYZE main.sqlite_master", error)
+                 || !execStatement(query, "DELETE FROM main.sqlite_stat1", error)))
+            || !execStatement(query, "INSERT INTO main." + table + " SELECT * FROM " + quotedName(from) + "." + table,
+                              error)) {
+            return false;
+        }
+    }
+
+    if (!readSchemaObjects(query, from, "type IN ('index', 'trigger', 'view')", objects, error)) {
+        return false;
+    }
+    for (const SchemaObject &object : objects) {
+        if (!execStatement(query, object.sql, error)) {
+            return false;
+        }
+    }
+
+    if (!execStatement(query, QString("PRAGMA %1.user_version").arg(quotedName(from)), error) || !query.next()) {
+        return false;
+    }
+    return execStatement(query, QString("PRAGMA main.user_version = %1").arg(query.value(0).toInt()), error);
+}
+
+// Замена main копией присоединённой базы from без Online Backup API. Всё выполняется одной
+// транзакцией: main меняется целиком или остаётся прежней, а from читается из одного снимка,
+// даже если между шагами в неё пишут другие соединения. Таблицы копируются порциями по rowsPerStep
+// строк; после каждой порции вызываются progress(rowsCopied, rowCount) и cancelled
+bool copyAttached(QSqlDatabase &db, const QString &from, int rowsPerStep,
+                  const std::function<void(int, int)> &progress, const std::function<bool()> &cancelled,
+                  QString &error)
+{
+    if (!db.transaction()) {
+        error = db.lastError().text();
+        return false;
+    }
+    if (!replaceMainWith(db, from, rowsPerStep, progress, cancelled, error)) {
+        db.rollback();
+        return false;
+    }
+    if (!db.commit()) {
+        error = db.lastError().text();
+        db.rollback();
+        return false;
+    }
+    return true;
+}
+#endif
+
+} // namespace
+
+Database::Database(QObject *parent) : QObject(parent), m_cache(nullptr), m_hasFullText(false)
 {
 }
 
@@ -14,10 +563,18 @@ Database::~Database()
     closeDatabase();
 }
 
-bool Database::connectToDatabase(const QString &path)
+bool Database::connectToDatabase(const QString &path, const QString &connectionName, const DatabaseOptions &options)
 {
-    m_db = QSqlDatabase::addDatabase("QSQLITE");
+    // Всегда именованное соединение: QSqlQuery без явного соединения не должен молча попасть сюда
+    m_db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
     m_db.setDatabaseName(path);
+    // Параллельные соединения ждут освобождения блокировки, а не падают сразу
+    QString connectOptions = QString("QSQLITE_BUSY_TIMEOUT=%1").arg(options.busyTimeoutMs);
+    if (options.readOnly) {
+        connectOptions += ";QSQLITE_OPEN_READONLY";
+    }
+    m_db.setConnectOptions(connectOptions);
+    m_cache = &QueryCache::forDatabase(path, connectionName);
 
     if (!m_db.open()) {
         qDebug() << "Error: connection with database failed:" << m_db.lastError().text();
@@ -25,316 +582,1277 @@ bool Database::connectToDatabase(const QString &path)
     }
 
     // Отключаем внешние ключи для диагностики
-    QSqlQuery query;
+    QSqlQuery query(m_db);
     query.exec("PRAGMA foreign_keys = OFF;");
     qDebug() << "Foreign keys disabled for debugging";
 
-    // Создаем таблицы, если они не существуют
-    query.exec("CREATE TABLE IF NOT EXISTS books ("
-               "id INTEGER PRIMARY KEY AUTOINCREMENT, "
-               "title TEXT, "
-               "author TEXT, "
-               "year INTEGER, "
-               "genre TEXT, "
-               "available BOOLEAN)");
-    query.exec("CREATE TABLE IF NOT EXISTS readers ("
-               "id INTEGER PRIMARY KEY AUTOINCREMENT, "
-               "name TEXT, "
-               "contact TEXT)");
-    query.exec("CREATE TABLE IF NOT EXISTS loans ("
-               "id INTEGER PRIMARY KEY AUTOINCREMENT, "
-               "book_id INTEGER, "
-               "reader_id INTEGER, "
-               "issue_date TEXT)");
-    qDebug() << "Database: connection ok, tables created";
+    applyPragmas(options);
+
+    // Схему ведёт только пишущее соединение, читающие лишь узнают о наличии полнотекстового индекса
+    if (options.readOnly) {
+        m_hasFullText = hasFullTextIndex();
+        qDebug() << "Database: read-only connection" << connectionName << "ok";
+        return true;
+    }
+
+    if (!migrateSchema()) {
+        m_db.close();
+        return false;
+    }
+    m_hasFullText = hasFullTextIndex();
+    qDebug() << "Database: connection" << connectionName << "ok, schema version" << schemaVersion();
+
+    // Миграции могли изменить данные, а кэш мог остаться от прежнего подключения
+    m_cache->invalidate();
+    return true;
+}
+
+void Database::applyPragmas(const DatabaseOptions &options)
+{
+    QSqlQuery query(m_db);
+
+    // WAL: читатели не блокируют писателя и наоборот. Режим хранится в самом файле базы,
+    // поэтому его достаточно включить с пишущего соединения
+    if (!options.readOnly) {
+        if (!query.exec("PRAGMA journal_mode = WAL") || !query.next()
+            || query.value(0).toString().compare("wal", Qt::CaseInsensitive) != 0) {
+            qDebug() << "WAL journal mode is not available:" << query.lastError().text();
+        }
+    }
+
+    static const QStringList synchronousModes = { "OFF", "NORMAL", "FULL", "EXTRA" };
+    QString synchronous = options.synchronous.toUpper();
+    if (!synchronousModes.contains(synchronous)) {
+        qDebug() << "Unknown synchronous mode" << options.synchronous << ", using NORMAL";
+        synchronous = "NORMAL";
+    }
+    query.exec("PRAGMA synchronous = " + synchronous);
+    // Отрицательное значение cache_size задаётся в КиБ, а не в страницах
+    query.exec(QString("PRAGMA cache_size = -%1").arg(options.cacheSizeKiB));
+    query.exec(QString("PRAGMA mmap_size = %1").arg(options.mmapSize));
+}
+
+int Database::schemaVersion()
+{
+    QSqlQuery query(m_db);
+    if (!query.exec("PRAGMA user_version") || !query.next()) {
+        qDebug() << "Read schema version error:" << query.lastError().text();
+        return -1;
+    }
+    return query.value(0).toInt();
+}
+
+bool Database::migrateSchema()
+{
+    int version = schemaVersion();
+    if (version < 0) {
+        return false;
+    }
+
+    for (const Migration &migration : schemaMigrations()) {
+        if (migration.version <= version) {
+            continue;
+        }
+
+        // Каждый шаг вместе с новым номером версии фиксируется одной транзакцией:
+        // при ошибке база остаётся на предыдущей версии
+        m_db.transaction();
+        QSqlQuery query(m_db);
+        for (const QString &statement : migration.statements) {
+            if (query.exec(statement)) {
+                continue;
+            }
+            qDebug() << "Migration to version" << migration.version << "failed:" << query.lastError().text();
+            m_db.rollback();
+            if (!migration.optional) {
+                return false;
+            }
+            // Необязательный шаг откатывается целиком, в транзакции остаётся только номер версии
+            qDebug() << "Optional migration" << migration.version << "skipped";
+            m_db.transaction();
+            break;
+        }
+        if (!query.exec(QString("PRAGMA user_version = %1").arg(migration.version))) {
+            qDebug() << "Set schema version error:" << query.lastError().text();
+            m_db.rollback();
+            return false;
+        }
+        if (!m_db.commit()) {
+            qDebug() << "Commit failed for migration to version" << migration.version << ":" << m_db.lastError().text();
+            m_db.rollback();
+            return false;
+        }
+        version = migration.version;
+        qDebug() << "Schema migrated to version" << version << "-" << migration.description;
+    }
     return true;
 }
 
+bool Database::hasFullTextIndex()
+{
+    // Индекс создаёт миграция 7; без FTS5 в сборке SQLite её шаг пропускается
+    QSqlQuery query(m_db);
+    return query.exec("SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'books_fts'") && query.next();
+}
+
+QString Database::fullTextMatchExpression(const QString &searchTerm)
+{
+    // Каждое слово запроса становится префиксным термом: "войн"* найдёт "война", "войны" и т.д.
+    static const QRegularExpression separators("[^\\w]+", QRegularExpression::UseUnicodePropertiesOption);
+    QStringList terms;
+    const QStringList words = searchTerm.split(separators, Qt::SkipEmptyParts);
+    for (const QString &word : words) {
+        terms.append("\"" + word + "\"*");
+    }
+    return terms.join(' ');
+}
+
 void Database::closeDatabase()
 {
+    if (!m_db.isValid()) {
+        return;
+    }
+
+    QString connectionName = m_db.connectionName();
     if (m_db.isOpen()) {
         m_db.close();
     }
+    m_db = QSqlDatabase();
+    QSqlDatabase::removeDatabase(connectionName);
+}
+
+bool Database::addBook(const QString &title, const QString &author, int year, const QString &genre)
+{
+    if (!m_db.isOpen()) {
+        qDebug() << "Add book error: database is not open";
+        return false;
+    }
+
+    QSqlQuery query(m_db);
+    query.prepare("INSERT INTO books (title, author, year, genre, available) "
+                  "VALUES (:title, :author, :year, :genre, 1)");
+    query.bindValue(":title", title);
+    query.bindValue(":author", author);
+    query.bindValue(":year", year);
+    query.bindValue(":genre", genre);
+
+    if (!query.exec()) {
+        qDebug() << "Add book error:" << query.lastError().text();
+        return false;
+    }
+    m_cache->invalidate();
+    qDebug() << "Book added successfully";
+    emit bookInserted(query.lastInsertId().toInt());
+    return true;
+}
+
+bool Database::updateBook(int id, const QString &title, const QString &author, int year, const QString &genre)
+{
+    if (!m_db.isOpen()) {
+        qDebug() << "Update book error: database is not open";
+        return false;
+    }
+
+    QSqlQuery query(m_db);
+    query.prepare("UPDATE books SET title = :title, author = :author, year = :year, "
+                  "genre = :genre WHERE id = :id");
+    query.bindValue(":title", title);
+    query.bindValue(":author", author);
+    query.bindValue(":year", year);
+    query.bindValue(":genre", genre);
+    query.bindValue(":id", id);
+
+    if (!query.exec()) {
+        qDebug() << "Update book error for ID" << id << ":" << query.lastError().text();
+        return false;
+    }
+    m_cache->invalidate();
+    qDebug() << "Book updated successfully for ID:" << id;
+    emit bookUpdated(id);
+    return true;
+}
+
+bool Database::deleteBook(int id)
+{
+    if (!m_db.isOpen()) {
+        qDebug() << "Delete book error: database is not open";
+        return false;
+    }
+
+    qDebug() << "Starting delete book with ID:" << id;
+
+    // Проверяем существование книги
+    QSqlQuery checkQuery(m_db);
+    checkQuery.prepare("SELECT id FROM books WHERE id = :id");
+    checkQuery.bindValue(":id", id);
+    if (!checkQuery.exec() || !checkQuery.next()) {
+        qDebug() << "Delete book error: book with ID" << id << "does not exist";
+        return false;
+    }
+
+    m_db.transaction();
+
+    // Удаляем связанные записи в loans
+    QSqlQuery query(m_db);
+    query.prepare("DELETE FROM loans WHERE book_id = :id");
+    query.bindValue(":id", id);
+    if (!query.exec()) {
+        qDebug() << "Delete loans error for book ID" << id << ":" << query.lastError().text();
+        m_db.rollback();
+        return false;
+    }
+    qDebug() << "Loans deleted for book ID:" << id;
+
+    // Удаляем книгу
+    query.prepare("DELETE FROM books WHERE id = :id");
+    query.bindValue(":id", id);
+    if (!query.exec()) {
+        qDebug() << "Delete book error for ID" << id << ":" << query.lastError().text();
+        m_db.rollback();
+        return false;
+    }
+    qDebug() << "Book deleted successfully with ID:" << id;
+
+    if (!m_db.commit()) {
+        qDebug() << "Commit failed for book deletion:" << m_db.lastError().text();
+        m_db.rollback();
+        return false;
+    }
+    m_cache->invalidate();
+    qDebug() << "Transaction committed for book ID:" << id;
+    emit bookDeleted(id);
+    return true;
+}
+
+QVariantList Database::getAllBooks()
+{
+    QVariantList books;
+    if (!m_db.isOpen()) {
+        qDebug() << "Get all books error: database is not open";
+        return books;
+    }
+
+    const QString cacheKey = QueryCache::key("getAllBooks", QVariantList());
+    if (m_cache->lookup(cacheKey, books)) {
+        return books;
+    }
+    const quint64 generation = m_cache->generation();
+
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT b.id, b.title, b.author, b.year, b.genre, b.available, r.name AS reader_name "
+                    "FROM books b "
+                    "LEFT JOIN loans l ON b.id = l.book_id "
+                    "LEFT JOIN readers r ON l.reader_id = r.id "
+                    "ORDER BY b.title")) {
+        qDebug() << "Get all books error:" << query.lastError().text();
+        return books;
+    }
+
+    books = toVariantList(readBooks(query));
+    m_cache->insert(cacheKey, generation, books);
+    qDebug() << "Retrieved" << books.size() << "books";
+    return books;
+}
+
+QVariantList Database::searchBooks(const QString &searchTerm)
+{
+    QVariantList books;
+    if (!m_db.isOpen()) {
+        qDebug() << "Search books error: database is not open";
+        return books;
+    }
+
+    const QString cacheKey = QueryCache::key("searchBooks", { searchTerm });
+    if (m_cache->lookup(cacheKey, books)) {
+        return books;
+    }
+    const quint64 generation = m_cache->generation();
+
+    BookFilter filter;
+    filter.searchTerm = searchTerm;
+
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+    query.prepare("SELECT b.id, b.title, b.author, b.year, b.genre, b.available, r.name AS reader_name "
+                  "FROM books b "
+                  "LEFT JOIN loans l ON b.id = l.book_id "
+                  "LEFT JOIN readers r ON l.reader_id = r.id "
+                  "WHERE 1=1" + bookFilterClause(filter) +
+                  " ORDER BY b.title");
+    bindBookFilter(query, filter);
+
+    if (!query.exec()) {
+        qDebug() << "Search error:" << query.lastError().text();
+        return books;
+    }
+
+    books = toVariantList(readBooks(query));
+    m_cache->insert(cacheKey, generation, books);
+    qDebug() << "Found" << books.size() << "books for search term:" << searchTerm;
+    return books;
+}
+
+QVariantList Database::searchBooksRanked(const QString &searchTerm, int limit)
+{
+    QVariantList books;
+    if (!m_db.isOpen()) {
+        qDebug() << "Ranked search error: database is not open";
+        return books;
+    }
+
+    QString match = fullTextMatchExpression(searchTerm);
+    if (!m_hasFullText || match.isEmpty()) {
+        return searchBooks(searchTerm);
+    }
+
+    const QString cacheKey = QueryCache::key("searchBooksRanked", { searchTerm, clampPageSize(limit) });
+    if (m_cache->lookup(cacheKey, books)) {
+        return books;
+    }
+    const quint64 generation = m_cache->generation();
+
+    // bm25 с весами столбцов: совпадение в названии важнее, чем в авторе, а тем более в жанре
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+    query.prepare("SELECT b.id, b.title, b.author, b.year, b.genre, b.available, r.name AS reader_name "
+                  "FROM books_fts f "
+                  "JOIN books b ON b.id = f.rowid "
+                  "LEFT JOIN loans l ON b.id = l.book_id "
+                  "LEFT JOIN readers r ON l.reader_id = r.id "
+                  "WHERE books_fts MATCH :match "
+                  "ORDER BY bm25(books_fts, 10.0, 5.0, 1.0) "
+                  "LIMIT :limit");
+    query.bindValue(":match", match);
+    query.bindValue(":limit", clampPageSize(limit));
+
+    if (!query.exec()) {
+        qDebug() << "Ranked search error:" << query.lastError().text();
+        return books;
+    }
+
+    books = toVariantList(readBooks(query));
+    m_cache->insert(cacheKey, generation, books);
+    qDebug() << "Ranked search returned" << books.size() << "books for search term:" << searchTerm;
+    return books;
+}
+
+QVariantList Database::searchBooksAdvanced(const QString &searchTerm, int minYear, int maxYear, bool onlyAvailable, const QString &author, const QString &genre)
+{
+    QVariantList books;
+    if (!m_db.isOpen()) {
+        qDebug() << "Advanced search error: database is not open";
+        return books;
+    }
+
+    BookFilter filter;
+    filter.searchTerm = searchTerm;
+    filter.minYear = minYear;
+    filter.maxYear = maxYear;
+    filter.onlyAvailable = onlyAvailable;
+    filter.author = author;
+    filter.genre = genre;
+
+    // Неположительные границы годов означают «без ограничения» и дают один и тот же запрос
+    const QString cacheKey = QueryCache::key("searchBooksAdvanced",
+                                             { searchTerm, qMax(minYear, 0), qMax(maxYear, 0),
+                                               onlyAvailable, author, genre });
+    if (m_cache->lookup(cacheKey, books)) {
+        return books;
+    }
+    const quint64 generation = m_cache->generation();
+
+    QString queryStr = "SELECT b.id, b.title, b.author, b.year, b.genre, b.available, r.name AS reader_name "
+                      "FROM books b "
+                      "LEFT JOIN loans l ON b.id = l.book_id "
+                      "LEFT JOIN readers r ON l.reader_id = r.id "
+                      "WHERE 1=1" + bookFilterClause(filter) +
+                      " ORDER BY b.title";
+
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+    query.prepare(queryStr);
+    bindBookFilter(query, filter);
+
+    if (!query.exec()) {
+        qDebug() << "Advanced search error:" << query.lastError().text();
+        return books;
+    }
+
+    books = toVariantList(readBooks(query));
+    m_cache->insert(cacheKey, generation, books);
+    qDebug() << "Advanced search returned" << books.size() << "books";
+    return books;
+}
+
+QVariantList Database::getBooksPage(const QString &afterTitle, int afterId, int pageSize)
+{
+    return fetchBooksPage(BookFilter(), afterTitle, afterId, pageSize);
+}
+
+QVariantList Database::searchBooksPage(const QString &searchTerm, int minYear, int maxYear, bool onlyAvailable,
+                                       const QString &author, const QString &genre,
+                                       const QString &afterTitle, int afterId, int pageSize)
+{
+    BookFilter filter;
+    filter.searchTerm = searchTerm;
+    filter.minYear = minYear;
+    filter.maxYear = maxYear;
+    filter.onlyAvailable = onlyAvailable;
+    filter.author = author;
+    filter.genre = genre;
+    return fetchBooksPage(filter, afterTitle, afterId, pageSize);
+}
+
+int Database::countBooks(const QString &searchTerm, int minYear, int maxYear, bool onlyAvailable,
+                         const QString &author, const QString &genre)
+{
+    BookFilter filter;
+    filter.searchTerm = searchTerm;
+    filter.minYear = minYear;
+    filter.maxYear = maxYear;
+    filter.onlyAvailable = onlyAvailable;
+    filter.author = author;
+    filter.genre = genre;
+    return countBooksMatching(filter);
+}
+
+int Database::countBooksMatching(const BookFilter &filter)
+{
+    if (!m_db.isOpen()) {
+        qDebug() << "Count books error: database is not open";
+        return 0;
+    }
+
+    // Модель пересчитывает итог при каждой перезагрузке, а полный COUNT(*) — это проход по таблице
+    const QString cacheKey = QueryCache::key("countBooks",
+                                             { filter.searchTerm, usesFullText(filter), qMax(filter.minYear, 0),
+                                               qMax(filter.maxYear, 0), filter.onlyAvailable, filter.author,
+                                               filter.genre });
+    QVariantList cached;
+    if (m_cache->lookup(cacheKey, cached)) {
+        return cached.value(0).toInt();
+    }
+    const quint64 generation = m_cache->generation();
+
+    // Фильтр затрагивает только столбцы books, поэтому соединение с loans/readers не нужно
+    QSqlQuery query(m_db);
+    query.prepare("SELECT COUNT(*) FROM books b WHERE 1=1" + bookFilterClause(filter));
+    bindBookFilter(query, filter);
+
+    if (!query.exec() || !query.next()) {
+        qDebug() << "Count books error:" << query.lastError().text();
+        return 0;
+    }
+    int count = query.value(0).toInt();
+    m_cache->insert(cacheKey, generation, { count });
+    return count;
+}
+
+QVariantMap Database::facetCounts(const QString &searchTerm, int minYear, int maxYear, bool onlyAvailable,
+                                  const QString &author, const QString &genre, int limit)
+{
+    BookFilter filter;
+    filter.searchTerm = searchTerm;
+    filter.minYear = minYear;
+    filter.maxYear = maxYear;
+    filter.onlyAvailable = onlyAvailable;
+    filter.author = author;
+    filter.genre = genre;
+    return facetCountsMatching(filter, limit);
+}
+
+QVariantMap Database::facetCountsMatching(const BookFilter &filter, int limit)
+{
+    QVariantMap facets;
+    if (!m_db.isOpen()) {
+        qDebug() << "Facet counts error: database is not open";
+        return facets;
+    }
+
+    if (limit <= 0) {
+        limit = -1;
+    }
+    const QString cacheKey = QueryCache::key("facetCounts",
+                                             { filter.searchTerm, usesFullText(filter), qMax(filter.minYear, 0),
+                                               qMax(filter.maxYear, 0), filter.onlyAvailable, filter.author,
+                                               filter.genre, limit });
+    QVariantList cached;
+    if (m_cache->lookup(cacheKey, cached)) {
+        return cached.value(0).toMap();
+    }
+    const quint64 generation = m_cache->generation();
+
+    // Для всего каталога достаточно прочитать сводную таблицу; фильтр же требует группировки
+    // отобранных книг, зато затрагивает только столбцы books
+    const bool summary = isEmptyFilter(filter);
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+    if (summary) {
+        if (!query.exec("SELECT COALESCE(SUM(count), 0) FROM book_facets WHERE facet = 'available'") || !query.next()) {
+            qDebug() << "Facet counts error:" << query.lastError().text();
+            return facets;
+        }
+        facets["total"] = query.value(0).toInt();
+    } else {
+        facets["total"] = countBooksMatching(filter);
+    }
+
+    for (const Facet &facet : bookFacets()) {
+        const QString order = facet.orderByValue ? "value" : "count DESC, value";
+        if (summary) {
+            query.prepare("SELECT value, count FROM book_facets WHERE facet = :facet "
+                          "ORDER BY " + order + " LIMIT :limit");
+            query.bindValue(":facet", facet.name);
+        } else {
+            query.prepare(QString("SELECT %1 AS value, COUNT(*) AS count FROM books b WHERE 1=1")
+                              .arg(QString(facet.expression).arg("b."))
+                          + bookFilterClause(filter) + " GROUP BY value ORDER BY " + order + " LIMIT :limit");
+            bindBookFilter(query, filter);
+        }
+        query.bindValue(":limit", limit);
+        if (!query.exec()) {
+            qDebug() << "Facet counts error for" << facet.name << ":" << query.lastError().text();
+            return QVariantMap();
+        }
+
+        QVariantList values;
+        while (query.next()) {
+            QVariantMap value;
+            value["value"] = query.value(0);
+            value["count"] = query.value(1).toInt();
+            values.append(value);
+        }
+        facets[facet.name] = values;
+    }
+    m_cache->insert(cacheKey, generation, { facets });
+    return facets;
+}
+
+int Database::countReaders()
+{
+    if (!m_db.isOpen()) {
+        qDebug() << "Count readers error: database is not open";
+        return 0;
+    }
+
+    QSqlQuery query(m_db);
+    if (!query.exec("SELECT COUNT(*) FROM readers") || !query.next()) {
+        qDebug() << "Count readers error:" << query.lastError().text();
+        return 0;
+    }
+    return query.value(0).toInt();
+}
+
+QSqlQuery Database::queryBooksPage(const BookFilter &filter, const QString &afterTitle, int afterId, int pageSize)
+{
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+    if (!m_db.isOpen()) {
+        qDebug() << "Get books page error: database is not open";
+        return query;
+    }
+
+    // Keyset-пагинация: продолжаем строго после последней показанной пары (title, id),
+    // поэтому стоимость страницы не зависит от её номера (в отличие от OFFSET)
+    QString queryStr = "SELECT b.id, b.title, b.author, b.year, b.genre, b.available, r.name AS reader_name "
+                      "FROM books b "
+                      "LEFT JOIN loans l ON b.id = l.book_id "
+                      "LEFT JOIN readers r ON l.reader_id = r.id "
+                      "WHERE 1=1" + bookFilterClause(filter);
+    // Книга без названия иначе оборвала бы выдачу: сравнение с NULL не бывает истинным
+    if (afterId > 0) {
+        queryStr += " AND (COALESCE(b.title, ''), b.id) > (:afterTitle, :afterId)";
+    }
+    queryStr += " ORDER BY COALESCE(b.title, ''), b.id LIMIT :pageSize";
+
+    query.prepare(queryStr);
+    bindBookFilter(query, filter);
+    if (afterId > 0) {
+        // Пустая QString без данных привязывается как NULL, а ключ строки — пустая строка
+        query.bindValue(":afterTitle", afterTitle.isNull() ? QString("") : afterTitle);
+        query.bindValue(":afterId", afterId);
+    }
+    query.bindValue(":pageSize", clampPageSize(pageSize));
+
+    if (!query.exec()) {
+        qDebug() << "Get books page error:" << query.lastError().text();
+    }
+    return query;
+}
+
+QSqlQuery Database::queryReadersPage(const QString &afterName, int afterId, int pageSize)
+{
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+    if (!m_db.isOpen()) {
+        qDebug() << "Get readers page error: database is not open";
+        return query;
+    }
+
+    QString queryStr = "SELECT id, name, contact FROM readers";
+    if (afterId > 0) {
+        queryStr += " WHERE (COALESCE(name, ''), id) > (:afterName, :afterId)";
+    }
+    queryStr += " ORDER BY COALESCE(name, ''), id LIMIT :pageSize";
+
+    query.prepare(queryStr);
+    if (afterId > 0) {
+        query.bindValue(":afterName", afterName.isNull() ? QString("") : afterName);
+        query.bindValue(":afterId", afterId);
+    }
+    query.bindValue(":pageSize", clampPageSize(pageSize));
+
+    if (!query.exec()) {
+        qDebug() << "Get readers page error:" << query.lastError().text();
+    }
+    return query;
+}
+
+QSqlQuery Database::queryBooksById(const BookFilter &filter, const QVector<int> &ids)
+{
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+    if (!m_db.isOpen()) {
+        qDebug() << "Get books by ID error: database is not open";
+        return query;
+    }
+
+    // Идентификаторы — целые числа, поэтому подставляются в текст запроса напрямую:
+    // именованные параметры фильтра нельзя смешивать с позиционными
+    QString queryStr = "SELECT b.id, b.title, b.author, b.year, b.genre, b.available, r.name AS reader_name "
+                      "FROM books b "
+                      "LEFT JOIN loans l ON b.id = l.book_id "
+                      "LEFT JOIN readers r ON l.reader_id = r.id "
+                      "WHERE b.id IN (" + idList(ids) + ")" + bookFilterClause(filter);
+
+    query.prepare(queryStr);
+    bindBookFilter(query, filter);
+    if (!query.exec()) {
+        qDebug() << "Get books by ID error:" << query.lastError().text();
+    }
+    return query;
+}
+
+QSqlQuery Database::queryReadersById(const QVector<int> &ids)
+{
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+    if (!m_db.isOpen()) {
+        qDebug() << "Get readers by ID error: database is not open";
+        return query;
+    }
+
+    if (!query.exec("SELECT id, name, contact FROM readers WHERE id IN (" + idList(ids) + ")")) {
+        qDebug() << "Get readers by ID error:" << query.lastError().text();
+    }
+    return query;
+}
+
+QVector<int> Database::booksOnLoanTo(int readerId)
+{
+    QVector<int> bookIds;
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+    query.prepare("SELECT book_id FROM loans WHERE reader_id = :id");
+    query.bindValue(":id", readerId);
+    if (!query.exec()) {
+        qDebug() << "Get loans error for reader ID" << readerId << ":" << query.lastError().text();
+        return bookIds;
+    }
+    while (query.next()) {
+        bookIds.append(query.value(0).toInt());
+    }
+    return bookIds;
+}
+
+QString Database::idList(const QVector<int> &ids)
+{
+    QStringList numbers;
+    numbers.reserve(ids.size());
+    for (int id : ids) {
+        numbers.append(QString::number(id));
+    }
+    // Пустой список IN () недопустим, а NULL не совпадает ни с одним id
+    return numbers.isEmpty() ? QString("NULL") : numbers.join(',');
+}
+
+QVariantList Database::fetchBooksPage(const BookFilter &filter, const QString &afterTitle, int afterId, int pageSize)
+{
+    QVariantList books;
+    QSqlQuery query = queryBooksPage(filter, afterTitle, afterId, pageSize);
+    if (!query.isActive()) {
+        return books;
+    }
+
+    books = toVariantList(readBooks(query));
+    qDebug() << "Retrieved page of" << books.size() << "books after ID" << afterId;
+    return books;
+}
+
+QVector<Book> Database::readBooks(QSqlQuery &query)
+{
+    const QSqlRecord record = query.record();
+    const int id = record.indexOf("id");
+    const int title = record.indexOf("title");
+    const int author = record.indexOf("author");
+    const int year = record.indexOf("year");
+    const int genre = record.indexOf("genre");
+    const int available = record.indexOf("available");
+    const int readerName = record.indexOf("reader_name");
+
+    QVector<Book> books;
+    while (query.next()) {
+        Book book;
+        book.id = query.value(id).toInt();
+        book.title = query.value(title).toString();
+        book.author = query.value(author).toString();
+        book.year = query.value(year).toInt();
+        book.genre = query.value(genre).toString();
+        book.available = query.value(available).toBool();
+        if (readerName >= 0) {
+            book.readerName = query.value(readerName).toString();
+        }
+        books.append(book);
+    }
+    return books;
+}
+
+QVector<Reader> Database::readReaders(QSqlQuery &query)
+{
+    const QSqlRecord record = query.record();
+    const int id = record.indexOf("id");
+    const int name = record.indexOf("name");
+    const int contact = record.indexOf("contact");
+
+    QVector<Reader> readers;
+    while (query.next()) {
+        Reader reader;
+        reader.id = query.value(id).toInt();
+        reader.name = query.value(name).toString();
+        reader.contact = query.value(contact).toString();
+        readers.append(reader);
+    }
+    return readers;
+}
+
+QVariantList Database::toVariantList(const QVector<Book> &books)
+{
+    // Ключи создаются один раз: иначе каждая вставка строила бы QString из литерала
+    static const QString idKey = QStringLiteral("id");
+    static const QString titleKey = QStringLiteral("title");
+    static const QString authorKey = QStringLiteral("author");
+    static const QString yearKey = QStringLiteral("year");
+    static const QString genreKey = QStringLiteral("genre");
+    static const QString availableKey = QStringLiteral("available");
+    static const QString readerNameKey = QStringLiteral("reader_name");
+
+    QVariantList list;
+    list.reserve(books.size());
+    for (const Book &book : books) {
+        QVariantMap map;
+        map.insert(idKey, book.id);
+        map.insert(titleKey, book.title);
+        map.insert(authorKey, book.author);
+        map.insert(yearKey, book.year);
+        map.insert(genreKey, book.genre);
+        map.insert(availableKey, book.available);
+        map.insert(readerNameKey, book.readerName);
+        list.append(map);
+    }
+    return list;
+}
+
+QVariantList Database::toVariantList(const QVector<Reader> &readers)
+{
+    static const QString idKey = QStringLiteral("id");
+    static const QString nameKey = QStringLiteral("name");
+    static const QString contactKey = QStringLiteral("contact");
+
+    QVariantList list;
+    list.reserve(readers.size());
+    for (const Reader &reader : readers) {
+        QVariantMap map;
+        map.insert(idKey, reader.id);
+        map.insert(nameKey, reader.name);
+        map.insert(contactKey, reader.contact);
+        list.append(map);
+    }
+    return list;
+}
+
+bool Database::isEmptyFilter(const BookFilter &filter)
+{
+    return filter.searchTerm.isEmpty() && filter.minYear <= 0 && filter.maxYear <= 0 && !filter.onlyAvailable
+           && filter.author.isEmpty() && filter.genre.isEmpty();
+}
+
+int Database::clampPageSize(int pageSize)
+{
+    if (pageSize <= 0) {
+        return DefaultPageSize;
+    }
+    return qMin(pageSize, static_cast<int>(MaxPageSize));
+}
+
+bool Database::usesFullText(const BookFilter &filter) const
+{
+    // Строка без единого слова не даёт выражения MATCH и ищется подстрокой
+    return filter.fullText && m_hasFullText && !fullTextMatchExpression(filter.searchTerm).isEmpty();
+}
+
+QString Database::bookFilterClause(const BookFilter &filter) const
+{
+    QString clause;
+    if (usesFullText(filter)) {
+        // Книги отбираются по индексу, а не проходом по books с LIKE '%...%': и COUNT(*),
+        // и keyset-страницы читают только найденные строки
+        clause += " AND b.id IN (SELECT rowid FROM books_fts WHERE books_fts MATCH :search)";
+    } else if (!filter.searchTerm.isEmpty()) {
+        clause += " AND (b.title LIKE :search OR b.author LIKE :search OR b.genre LIKE :search)";
+    }
+    if (filter.minYear > 0) {
+        clause += " AND b.year >= :minYear";
+    }
+    if (filter.maxYear > 0) {
+        clause += " AND b.year <= :maxYear";
+    }
+    if (filter.onlyAvailable) {
+        clause += " AND b.available = 1";
+    }
+    if (!filter.author.isEmpty()) {
+        clause += " AND b.author LIKE :author";
+    }
+    if (!filter.genre.isEmpty()) {
+        clause += " AND b.genre LIKE :genre";
+    }
+    return clause;
+}
+
+void Database::bindBookFilter(QSqlQuery &query, const BookFilter &filter) const
+{
+    if (usesFullText(filter)) {
+        query.bindValue(":search", fullTextMatchExpression(filter.searchTerm));
+    } else if (!filter.searchTerm.isEmpty()) {
+        query.bindValue(":search", "%" + filter.searchTerm + "%");
+    }
+    if (filter.minYear > 0) {
+        query.bindValue(":minYear", filter.minYear);
+    }
+    if (filter.maxYear > 0) {
+        query.bindValue(":maxYear", filter.maxYear);
+    }
+    if (!filter.author.isEmpty()) {
+        query.bindValue(":author", "%" + filter.author + "%");
+    }
+    if (!filter.genre.isEmpty()) {
+        query.bindValue(":genre", "%" + filter.genre + "%");
+    }
+}
+
+QVariantMap Database::cacheStats() const
+{
+    return m_cache ? m_cache->stats() : QVariantMap();
+}
+
+bool Database::exportToCSV(const QString &filePath)
+{
+    return exportBooks(filePath, BookExporter::Csv);
+}
+
+bool Database::exportToJSONL(const QString &filePath)
+{
+    return exportBooks(filePath, BookExporter::JsonLines);
 }
 
-bool Database::addBook(const QString &title, const QString &author, int year, const QString &genre, bool available)
+bool Database::exportBooks(const QString &filePath, BookExporter::Format format,
+                           const std::function<void(qint64)> &progress, const std::function<bool()> &cancelled)
 {
     if (!m_db.isOpen()) {
-        qDebug() << "Add book error: database is not open";
+        qDebug() << "Export error: database is not open";
         return false;
     }
 
-    QSqlQuery query;
-    query.prepare("INSERT INTO books (title, author, year, genre, available) "
-                  "VALUES (:title, :author, :year, :genre, :available)");
-    query.bindValue(":title", title);
-    query.bindValue(":author", author);
-    query.bindValue(":year", year);
-    query.bindValue(":genre", genre);
-    query.bindValue(":available", available);
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT b.id, b.title, b.author, b.year, b.genre, b.available, r.name AS reader_name "
+                    "FROM books b "
+                    "LEFT JOIN loans l ON b.id = l.book_id "
+                    "LEFT JOIN readers r ON l.reader_id = r.id "
+                    "ORDER BY b.title")) {
+        qDebug() << "Export error:" << query.lastError().text();
+        return false;
+    }
 
-    if (!query.exec()) {
-        qDebug() << "Add book error:" << query.lastError().text();
+    BookExporter exporter(format);
+    if (progress) {
+        exporter.setProgressCallback(progress);
+    }
+    if (cancelled) {
+        exporter.setCancelCheck(cancelled);
+    }
+    if (!exporter.exportQuery(query, filePath)) {
+        qDebug() << "Export error:" << exporter.errorString();
         return false;
     }
-    qDebug() << "Book added successfully";
+    qDebug() << "Exported" << exporter.rowsWritten() << "books to" << filePath;
     return true;
 }
 
-bool Database::updateBook(int id, const QString &title, const QString &author, int year, const QString &genre, bool available)
+bool Database::backupTo(const QString &targetPath, const std::function<void(int, int)> &progress,
+                        const std::function<bool()> &cancelled, int pagesPerStep)
 {
     if (!m_db.isOpen()) {
-        qDebug() << "Update book error: database is not open";
+        qDebug() << "Backup error: database is not open";
         return false;
     }
 
-    QSqlQuery query;
-    query.prepare("UPDATE books SET title = :title, author = :author, year = :year, "
-                  "genre = :genre, available = :available WHERE id = :id");
-    query.bindValue(":title", title);
-    query.bindValue(":author", author);
-    query.bindValue(":year", year);
-    query.bindValue(":genre", genre);
-    query.bindValue(":available", available);
-    query.bindValue(":id", id);
+    // Прежняя копия остаётся на месте, пока новая не записана полностью
+    const QString snapshotPath = targetPath + ".part";
+    QFile::remove(snapshotPath);
 
-    if (!query.exec()) {
-        qDebug() << "Update book error for ID" << id << ":" << query.lastError().text();
+#ifdef LABA77_SQLITE_BACKUP_API
+    sqlite3 *source = nativeHandle(m_db);
+    if (!source) {
+        qDebug() << "Backup error: driver does not expose a sqlite3 handle";
         return false;
     }
-    qDebug() << "Book updated successfully for ID:" << id;
+    sqlite3 *destination = nullptr;
+    if (sqlite3_open_v2(snapshotPath.toUtf8().constData(), &destination,
+                        SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr) != SQLITE_OK) {
+        qDebug() << "Backup error: cannot create" << snapshotPath << ":" << sqlite3_errmsg(destination);
+        sqlite3_close(destination);
+        return false;
+    }
+    QString error;
+    bool copied = copyPages(destination, source, pagesPerStep, progress, cancelled, error);
+    sqlite3_close(destination);
+    if (!copied) {
+        qDebug() << "Backup error:" << error;
+        QFile::remove(snapshotPath);
+        return false;
+    }
+#else
+    // Снимок заполняется через отдельное соединение, к которому рабочая база присоединена
+    // на время копирования; само соединение m_db может быть только для чтения
+    const QString connectionName = m_db.connectionName() + "_backup";
+    QString error;
+    bool copied = false;
+    {
+        QSqlDatabase snapshot = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+        snapshot.setDatabaseName(snapshotPath);
+        if (!snapshot.open()) {
+            error = snapshot.lastError().text();
+        } else {
+            QSqlQuery query(snapshot);
+            query.prepare("ATTACH DATABASE :path AS source");
+            query.bindValue(":path", m_db.databaseName());
+            if (!query.exec()) {
+                error = query.lastError().text();
+            } else {
+                copied = copyAttached(snapshot, "source", pagesPerStep, progress, cancelled, error);
+                query.exec("DETACH DATABASE source");
+            }
+            snapshot.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+    if (!copied) {
+        qDebug() << "Backup error:" << error;
+        QFile::remove(snapshotPath);
+        return false;
+    }
+#endif
+
+    if (!replaceWithSnapshot(snapshotPath, targetPath)) {
+        return false;
+    }
+    qDebug() << "Database backed up to" << targetPath;
     return true;
 }
 
-bool Database::deleteBook(int id)
+bool Database::restoreFrom(const QString &sourcePath, const std::function<void(int, int)> &progress,
+                           const std::function<bool()> &cancelled, int pagesPerStep)
 {
     if (!m_db.isOpen()) {
-        qDebug() << "Delete book error: database is not open";
+        qDebug() << "Restore error: database is not open";
         return false;
     }
 
-    qDebug() << "Starting delete book with ID:" << id;
-
-    // Проверяем существование книги
-    QSqlQuery checkQuery;
-    checkQuery.prepare("SELECT id FROM books WHERE id = :id");
-    checkQuery.bindValue(":id", id);
-    if (!checkQuery.exec() || !checkQuery.next()) {
-        qDebug() << "Delete book error: book with ID" << id << "does not exist";
+    if (!validateSnapshot(sourcePath)) {
         return false;
     }
 
-    m_db.transaction();
-
-    // Удаляем связанные записи в loans
-    QSqlQuery query;
-    query.prepare("DELETE FROM loans WHERE book_id = :id");
-    query.bindValue(":id", id);
-    if (!query.exec()) {
-        qDebug() << "Delete loans error for book ID" << id << ":" << query.lastError().text();
-        m_db.rollback();
+#ifdef LABA77_SQLITE_BACKUP_API
+    sqlite3 *destination = nativeHandle(m_db);
+    if (!destination) {
+        qDebug() << "Restore error: driver does not expose a sqlite3 handle";
         return false;
     }
-    qDebug() << "Loans deleted for book ID:" << id;
-
-    // Удаляем книгу
-    query.prepare("DELETE FROM books WHERE id = :id");
-    query.bindValue(":id", id);
+    sqlite3 *source = nullptr;
+    if (sqlite3_open_v2(sourcePath.toUtf8().constData(), &source, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+        qDebug() << "Restore error: cannot open" << sourcePath << ":" << sqlite3_errmsg(source);
+        sqlite3_close(source);
+        return false;
+    }
+    // Запись в приёмник заблокирована до конца копирования, поэтому другие соединения
+    // видят либо прежнюю базу, либо восстановленную целиком
+    QString error;
+    bool copied = copyPages(destination, source, pagesPerStep, progress, cancelled, error);
+    sqlite3_close(source);
+#else
+    // Снимок присоединяется к пишущему соединению и копируется одной транзакцией:
+    // другие соединения видят либо прежнюю базу, либо восстановленную целиком
+    QSqlQuery query(m_db);
+    query.prepare("ATTACH DATABASE :path AS snapshot");
+    query.bindValue(":path", sourcePath);
     if (!query.exec()) {
-        qDebug() << "Delete book error for ID" << id << ":" << query.lastError().text();
-        m_db.rollback();
+        qDebug() << "Restore error: cannot attach" << sourcePath << ":" << query.lastError().text();
+        return false;
+    }
+    QString error;
+    bool copied = copyAttached(m_db, "snapshot", pagesPerStep, progress, cancelled, error);
+    query.exec("DETACH DATABASE snapshot");
+#endif
+    if (!copied) {
+        qDebug() << "Restore error:" << error;
         return false;
     }
-    qDebug() << "Book deleted successfully with ID:" << id;
 
-    if (!m_db.commit()) {
-        qDebug() << "Commit failed for book deletion:" << m_db.lastError().text();
-        m_db.rollback();
+    // Снимок мог быть снят более старой версией приложения
+    if (!migrateSchema()) {
+        qDebug() << "Restore error: restored database cannot be migrated";
         return false;
     }
-    qDebug() << "Transaction committed for book ID:" << id;
+    m_hasFullText = hasFullTextIndex();
+    m_cache->invalidate();
+    qDebug() << "Database restored from" << sourcePath << ", schema version" << schemaVersion();
+    emit databaseRestored();
     return true;
 }
 
-QVariantList Database::getAllBooks()
+bool Database::compactTo(const QString &targetPath)
 {
-    QVariantList books;
     if (!m_db.isOpen()) {
-        qDebug() << "Get all books error: database is not open";
-        return books;
-    }
-
-    QSqlQuery query("SELECT b.id, b.title, b.author, b.year, b.genre, b.available, r.name AS reader_name "
-                    "FROM books b "
-                    "LEFT JOIN loans l ON b.id = l.book_id "
-                    "LEFT JOIN readers r ON l.reader_id = r.id "
-                    "ORDER BY b.title");
-    if (!query.exec()) {
-        qDebug() << "Get all books error:" << query.lastError().text();
-        return books;
+        qDebug() << "Compact error: database is not open";
+        return false;
     }
 
-    while (query.next()) {
-        QVariantMap book;
-        book["id"] = query.value("id");
-        book["title"] = query.value("title");
-        book["author"] = query.value("author");
-        book["year"] = query.value("year");
-        book["genre"] = query.value("genre");
-        book["available"] = query.value("available");
-        book["reader_name"] = query.value("reader_name").toString();
-        books.append(book);
+    const QString snapshotPath = targetPath + ".part";
+    QFile::remove(snapshotPath);
+    if (!vacuumInto(snapshotPath) || !replaceWithSnapshot(snapshotPath, targetPath)) {
+        return false;
     }
-    qDebug() << "Retrieved" << books.size() << "books";
-    return books;
+    qDebug() << "Compacted copy written to" << targetPath;
+    return true;
 }
 
-QVariantList Database::searchBooks(const QString &searchTerm)
+bool Database::vacuumInto(const QString &path)
 {
-    QVariantList books;
-    if (!m_db.isOpen()) {
-        qDebug() << "Search books error: database is not open";
-        return books;
-    }
-
-    QSqlQuery query;
-    query.prepare("SELECT b.id, b.title, b.author, b.year, b.genre, b.available, r.name AS reader_name "
-                  "FROM books b "
-                  "LEFT JOIN loans l ON b.id = l.book_id "
-                  "LEFT JOIN readers r ON l.reader_id = r.id "
-                  "WHERE b.title LIKE :search OR b.author LIKE :search OR b.genre LIKE :search "
-                  "ORDER BY b.title");
-    query.bindValue(":search", "%" + searchTerm + "%");
-
+    // VACUUM INTO читает базу в одной транзакции чтения и в режиме WAL не мешает записи;
+    // работает и с соединением только для чтения
+    QSqlQuery query(m_db);
+    query.prepare("VACUUM INTO :path");
+    query.bindValue(":path", path);
     if (!query.exec()) {
-        qDebug() << "Search error:" << query.lastError().text();
-        return books;
-    }
-
-    while (query.next()) {
-        QVariantMap book;
-        book["id"] = query.value("id");
-        book["title"] = query.value("title");
-        book["author"] = query.value("author");
-        book["year"] = query.value("year");
-        book["genre"] = query.value("genre");
-        book["available"] = query.value("available");
-        book["reader_name"] = query.value("reader_name").toString();
-        books.append(book);
+        qDebug() << "VACUUM INTO error for" << path << ":" << query.lastError().text();
+        QFile::remove(path);
+        return false;
     }
-    qDebug() << "Found" << books.size() << "books for search term:" << searchTerm;
-    return books;
+    return true;
 }
 
-QVariantList Database::searchBooksAdvanced(const QString &searchTerm, int minYear, int maxYear, bool onlyAvailable, const QString &author, const QString &genre)
+bool Database::validateSnapshot(const QString &path)
 {
-    QVariantList books;
-    if (!m_db.isOpen()) {
-        qDebug() << "Advanced search error: database is not open";
-        return books;
+    if (!QFileInfo::exists(path)) {
+        qDebug() << "Restore error: snapshot does not exist:" << path;
+        return false;
     }
 
-    QString queryStr = "SELECT b.id, b.title, b.author, b.year, b.genre, b.available, r.name AS reader_name "
-                      "FROM books b "
-                      "LEFT JOIN loans l ON b.id = l.book_id "
-                      "LEFT JOIN readers r ON l.reader_id = r.id "
-                      "WHERE 1=1";
-    if (!searchTerm.isEmpty()) {
-        queryStr += " AND (b.title LIKE :search OR b.author LIKE :search OR b.genre LIKE :search)";
-    }
-    if (minYear > 0) {
-        queryStr += " AND b.year >= :minYear";
-    }
-    if (maxYear > 0) {
-        queryStr += " AND b.year <= :maxYear";
+    // Отдельное соединение только для чтения: повреждённый или чужой файл не должен
+    // затереть рабочую базу
+    const QString connectionName = m_db.connectionName() + "_snapshot_check";
+    bool valid = false;
+    {
+        QSqlDatabase snapshot = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+        snapshot.setDatabaseName(path);
+        snapshot.setConnectOptions("QSQLITE_OPEN_READONLY");
+        if (!snapshot.open()) {
+            qDebug() << "Restore error: cannot open snapshot" << path << ":" << snapshot.lastError().text();
+        } else {
+            QSqlQuery query(snapshot);
+            if (!query.exec("PRAGMA quick_check") || !query.next() || query.value(0).toString() != "ok") {
+                qDebug() << "Restore error: snapshot" << path << "failed quick_check:" << query.value(0).toString();
+            } else if (!query.exec("PRAGMA user_version") || !query.next()
+                       || query.value(0).toInt() > schemaMigrations().last().version) {
+                qDebug() << "Restore error: snapshot" << path << "has unknown schema version" << query.value(0).toInt();
+            } else if (!query.exec("SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'books'")
+                       || !query.next()) {
+                qDebug() << "Restore error:" << path << "is not a library database";
+            } else {
+                valid = true;
+            }
+            snapshot.close();
+        }
     }
-    if (onlyAvailable) {
-        queryStr += " AND b.available = 1";
-    }
-    if (!author.isEmpty()) {
-        queryStr += " AND b.author LIKE :author";
-    }
-    if (!genre.isEmpty()) {
-        queryStr += " AND b.genre LIKE :genre";
-    }
-    queryStr += " ORDER BY b.title";
+    QSqlDatabase::removeDatabase(connectionName);
+    return valid;
+}
 
-    QSqlQuery query;
-    query.prepare(queryStr);
-    if (!searchTerm.isEmpty()) {
-        query.bindValue(":search", "%" + searchTerm + "%");
-    }
-    if (minYear > 0) {
-        query.bindValue(":minYear", minYear);
-    }
-    if (maxYear > 0) {
-        query.bindValue(":maxYear", maxYear);
+bool Database::replaceWithSnapshot(const QString &snapshotPath, const QString &targetPath)
+{
+    // Прежняя копия отодвигается в сторону и удаляется только после того, как новая
+    // встала на её место: при любом сбое на диске остаётся хотя бы одна целая копия
+    const QString previousPath = targetPath + ".old";
+    const bool hadPrevious = QFile::exists(targetPath);
+    if (hadPrevious) {
+        QFile::remove(previousPath);
+        if (!QFile::rename(targetPath, previousPath)) {
+            qDebug() << "Cannot move aside" << targetPath;
+            QFile::remove(snapshotPath);
+            return false;
+        }
     }
-    if (!author.isEmpty()) {
-        query.bindValue(":author", "%" + author + "%");
+    if (!QFile::rename(snapshotPath, targetPath)) {
+        qDebug() << "Cannot move" << snapshotPath << "to" << targetPath;
+        if (hadPrevious) {
+            QFile::rename(previousPath, targetPath);
+        }
+        QFile::remove(snapshotPath);
+        return false;
     }
-    if (!genre.isEmpty()) {
-        query.bindValue(":genre", "%" + genre + "%");
+    if (hadPrevious) {
+        QFile::remove(previousPath);
     }
+    return true;
+}
 
-    if (!query.exec()) {
-        qDebug() << "Advanced search error:" << query.lastError().text();
-        return books;
-    }
+bool Database::importBooksFromCSV(const QString &filePath, int batchSize)
+{
+    // Столбцы ищутся по заголовку, поэтому подходит и файл, созданный exportToCSV. Его столбец
+    // available не читается: у импортированной книги нет выдачи, значит, она доступна
+    const QStringList columns = { "title", "author", "year", "genre" };
+    return importFromCSV(filePath, batchSize, columns,
+                         "INSERT INTO books (title, author, year, genre, available) VALUES (?, ?, ?, ?, 1)",
+                         [](QSqlQuery &query, const QStringList &values) {
+        query.bindValue(0, values.at(0));
+        query.bindValue(1, values.at(1));
+        query.bindValue(2, values.at(2).toInt());
+        query.bindValue(3, values.at(3));
+    });
+}
 
-    while (query.next()) {
-        QVariantMap book;
-        book["id"] = query.value("id");
-        book["title"] = query.value("title");
-        book["author"] = query.value("author");
-        book["year"] = query.value("year");
-        book["genre"] = query.value("genre");
-        book["available"] = query.value("available");
-        book["reader_name"] = query.value("reader_name").toString();
-        books.append(book);
-    }
-    qDebug() << "Advanced search returned" << books.size() << "books";
-    return books;
+bool Database::importReadersFromCSV(const QString &filePath, int batchSize)
+{
+    const QStringList columns = { "name", "contact" };
+    return importFromCSV(filePath, batchSize, columns,
+                         "INSERT INTO readers (name, contact) VALUES (?, ?)",
+                         [](QSqlQuery &query, const QStringList &values) {
+        query.bindValue(0, values.at(0));
+        query.bindValue(1, values.at(1));
+    });
 }
 
-bool Database::exportToCSV(const QString &filePath)
+bool Database::importFromCSV(const QString &filePath, int batchSize, const QStringList &columns,
+                             const QString &insertSql, const RowBinder &bindRow)
 {
+    int rowsImported = 0;
+    bool success = importCsvRows(filePath, batchSize, columns, insertSql, bindRow, rowsImported);
+    emit importFinished(filePath, success, rowsImported);
+    return success;
+}
+
+bool Database::importCsvRows(const QString &filePath, int batchSize, const QStringList &columns,
+                             const QString &insertSql, const RowBinder &bindRow, int &rowsImported)
+{
+    rowsImported = 0;
     if (!m_db.isOpen()) {
-        qDebug() << "Export error: database is not open";
+        qDebug() << "Import error: database is not open";
         return false;
     }
+    if (batchSize <= 0) {
+        batchSize = DefaultImportBatchSize;
+    }
 
-    QSqlQuery query("SELECT b.id, b.title, b.author, b.year, b.genre, b.available, r.name AS reader_name "
-                    "FROM books b "
-                    "LEFT JOIN loans l ON b.id = l.book_id "
-                    "LEFT JOIN readers r ON l.reader_id = r.id "
-                    "ORDER BY b.title");
-    if (!query.exec()) {
-        qDebug() << "Export error:" << query.lastError().text();
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qDebug() << "Cannot open file for reading:" << filePath;
         return false;
     }
+    QTextStream in(&file);
 
-    QFile file(filePath);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        qDebug() << "Cannot open file for writing:" << filePath;
+    // Позиции столбцов определяются по заголовку один раз на весь файл
+    QStringList header;
+    if (!readCsvRecord(in, header)) {
+        qDebug() << "Import error: file is empty:" << filePath;
+        return false;
+    }
+    QVector<int> columnIndex;
+    for (const QString &column : columns) {
+        int index = -1;
+        for (int i = 0; i < header.size(); ++i) {
+            if (header.at(i).trimmed().compare(column, Qt::CaseInsensitive) == 0) {
+                index = i;
+                break;
+            }
+        }
+        columnIndex.append(index);
+    }
+    if (columnIndex.first() < 0) {
+        qDebug() << "Import error: column" << columns.first() << "not found in" << filePath;
+        return false;
+    }
+
+    // Один подготовленный запрос на весь импорт, фиксация пачками по batchSize строк
+    QSqlQuery query(m_db);
+    if (!query.prepare(insertSql)) {
+        qDebug() << "Import prepare error:" << query.lastError().text();
         return false;
     }
 
-    QTextStream out(&file);
-    out << "ID,Title,Author,Year,Genre,Available,Reader\n";
+    QStringList fields;
+    QStringList values;
+    int rowsInBatch = 0;
+    m_db.transaction();
+    while (readCsvRecord(in, fields)) {
+        if (fields.size() == 1 && fields.first().isEmpty()) {
+            continue;
+        }
 
-    while (query.next()) {
-        out << query.value("id").toString() << ","
-            << "\"" << query.value("title").toString() << "\","
-            << "\"" << query.value("author").toString() << "\","
-            << query.value("year").toString() << ","
-            << "\"" << query.value("genre").toString() << "\","
-            << (query.value("available").toBool() ? "Yes" : "No") << ","
-            << "\"" << query.value("reader_name").toString() << "\"\n";
+        values.clear();
+        for (int index : columnIndex) {
+            values.append(index >= 0 && index < fields.size() ? fields.at(index) : QString());
+        }
+        bindRow(query, values);
+        if (!query.exec()) {
+            qDebug() << "Import error at record" << rowsImported + rowsInBatch + 1 << ":" << query.lastError().text();
+            m_db.rollback();
+            return false;
+        }
+
+        if (++rowsInBatch == batchSize) {
+            if (!m_db.commit()) {
+                qDebug() << "Commit failed during import:" << m_db.lastError().text();
+                m_db.rollback();
+                return false;
+            }
+            rowsImported += rowsInBatch;
+            rowsInBatch = 0;
+            m_cache->invalidate();
+            emit importProgress(filePath, rowsImported);
+            m_db.transaction();
+        }
     }
 
-    file.close();
-    qDebug() << "Exported to CSV:" << filePath;
+    if (!m_db.commit()) {
+        qDebug() << "Commit failed during import:" << m_db.lastError().text();
+        m_db.rollback();
+        return false;
+    }
+    rowsImported += rowsInBatch;
+    m_cache->invalidate();
+    emit importProgress(filePath, rowsImported);
+    qDebug() << "Imported" << rowsImported << "rows from" << filePath;
     return true;
 }
 
@@ -345,7 +1863,7 @@ bool Database::addReader(const QString &name, const QString &contact)
         return false;
     }
 
-    QSqlQuery query;
+    QSqlQuery query(m_db);
     query.prepare("INSERT INTO readers (name, contact) VALUES (:name, :contact)");
     query.bindValue(":name", name);
     query.bindValue(":contact", contact);
@@ -354,7 +1872,9 @@ bool Database::addReader(const QString &name, const QString &contact)
         qDebug() << "Add reader error:" << query.lastError().text();
         return false;
     }
+    m_cache->invalidate();
     qDebug() << "Reader added successfully";
+    emit readerInserted(query.lastInsertId().toInt());
     return true;
 }
 
@@ -365,7 +1885,7 @@ bool Database::updateReader(int id, const QString &name, const QString &contact)
         return false;
     }
 
-    QSqlQuery query;
+    QSqlQuery query(m_db);
     query.prepare("UPDATE readers SET name = :name, contact = :contact WHERE id = :id");
     query.bindValue(":name", name);
     query.bindValue(":contact", contact);
@@ -375,7 +1895,13 @@ bool Database::updateReader(int id, const QString &name, const QString &contact)
         qDebug() << "Update reader error for ID" << id << ":" << query.lastError().text();
         return false;
     }
+    m_cache->invalidate();
     qDebug() << "Reader updated successfully for ID:" << id;
+    emit readerUpdated(id);
+    // Имя читателя показывается и в строках выданных ему книг
+    for (int bookId : booksOnLoanTo(id)) {
+        emit loanChanged(bookId);
+    }
     return true;
 }
 
@@ -389,7 +1915,7 @@ bool Database::deleteReader(int id)
     qDebug() << "Starting delete reader with ID:" << id;
 
     // Проверяем существование читателя
-    QSqlQuery checkQuery;
+    QSqlQuery checkQuery(m_db);
     checkQuery.prepare("SELECT id FROM readers WHERE id = :id");
     checkQuery.bindValue(":id", id);
     if (!checkQuery.exec() || !checkQuery.next()) {
@@ -397,10 +1923,13 @@ bool Database::deleteReader(int id)
         return false;
     }
 
+    // Книги, выданные читателю, после удаления его выдач меняют свои строки в списке
+    const QVector<int> loanedBookIds = booksOnLoanTo(id);
+
     m_db.transaction();
 
     // Удаляем связанные записи в loans
-    QSqlQuery query;
+    QSqlQuery query(m_db);
     query.prepare("DELETE FROM loans WHERE reader_id = :id");
     query.bindValue(":id", id);
     if (!query.exec()) {
@@ -425,7 +1954,12 @@ bool Database::deleteReader(int id)
         m_db.rollback();
         return false;
     }
+    m_cache->invalidate();
     qDebug() << "Transaction committed for reader ID:" << id;
+    emit readerDeleted(id);
+    for (int bookId : loanedBookIds) {
+        emit loanChanged(bookId);
+    }
     return true;
 }
 
@@ -437,63 +1971,101 @@ QVariantList Database::getAllReaders()
         return readers;
     }
 
-    QSqlQuery query("SELECT * FROM readers ORDER BY name");
-    if (!query.exec()) {
-        qDebug() << "Get all readers error:" << query.lastError().text();
+    const QString cacheKey = QueryCache::key("getAllReaders", QVariantList());
+    if (m_cache->lookup(cacheKey, readers)) {
         return readers;
     }
+    const quint64 generation = m_cache->generation();
 
-    while (query.next()) {
-        QVariantMap reader;
-        reader["id"] = query.value("id");
-        reader["name"] = query.value("name");
-        reader["contact"] = query.value("contact");
-        readers.append(reader);
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT id, name, contact FROM readers ORDER BY name")) {
+        qDebug() << "Get all readers error:" << query.lastError().text();
+        return readers;
     }
+
+    readers = toVariantList(readReaders(query));
+    m_cache->insert(cacheKey, generation, readers);
     qDebug() << "Retrieved" << readers.size() << "readers";
     return readers;
 }
 
-bool Database::issueBook(int bookId, int readerId)
+bool Database::issueBook(int bookId, int readerId, int loanDays)
+{
+    return issueBookList(readerId, { bookId }, loanDays);
+}
+
+bool Database::issueBooks(int readerId, const QVariantList &bookIds, int loanDays)
+{
+    QVector<int> ids;
+    ids.reserve(bookIds.size());
+    for (const QVariant &bookId : bookIds) {
+        ids.append(bookId.toInt());
+    }
+    return issueBookList(readerId, ids, loanDays);
+}
+
+bool Database::issueBookList(int readerId, const QVector<int> &bookIds, int loanDays)
 {
     if (!m_db.isOpen()) {
         qDebug() << "Issue book error: database is not open";
         return false;
     }
-
-    // Проверяем, доступна ли книга
-    QSqlQuery query;
-    query.prepare("SELECT available FROM books WHERE id = :id");
-    query.bindValue(":id", bookId);
-    if (!query.exec() || !query.next()) {
-        qDebug() << "Check book availability error for book ID" << bookId << ":" << query.lastError().text();
+    if (bookIds.isEmpty()) {
+        qDebug() << "Issue book error: no books given for reader ID" << readerId;
         return false;
     }
-    if (!query.value("available").toBool()) {
-        qDebug() << "Book with ID" << bookId << "is not available";
+
+    // Вся стопка книг выдаётся одной транзакцией: либо все книги, либо ни одной
+    if (!m_db.transaction()) {
+        qDebug() << "Issue book error: cannot start transaction:" << m_db.lastError().text();
         return false;
     }
 
-    // Добавляем запись в loans
-    query.prepare("INSERT INTO loans (book_id, reader_id, issue_date) "
-                  "VALUES (:book_id, :reader_id, :issue_date)");
-    query.bindValue(":book_id", bookId);
-    query.bindValue(":reader_id", readerId);
-    query.bindValue(":issue_date", QDateTime::currentDateTime().toString(Qt::ISODate));
-    if (!query.exec()) {
-        qDebug() << "Issue book error:" << query.lastError().text();
-        return false;
+    // Условное обновление одновременно проверяет и занимает книгу: конкурирующая выдача
+    // той же книги изменит ноль строк, а не создаст вторую запись в loans
+    QSqlQuery reserveQuery(m_db);
+    reserveQuery.prepare("UPDATE books SET available = 0 WHERE id = :id AND available = 1");
+    // Запись о выдаче появляется, только если читатель существует
+    QSqlQuery loanQuery(m_db);
+    loanQuery.prepare("INSERT INTO loans (book_id, reader_id, issue_date, issued_at, due_at) "
+                      "SELECT :book_id, id, :issue_date, :issued_at, :due_at FROM readers WHERE id = :reader_id");
+    const QDateTime now = QDateTime::currentDateTime();
+    const QString issueDate = now.toString(Qt::ISODate);
+    const qint64 issuedAt = now.toSecsSinceEpoch();
+    const qint64 dueAt = issuedAt + qint64(loanDays > 0 ? loanDays : DefaultLoanDays) * SecondsPerDay;
+
+    for (int bookId : bookIds) {
+        reserveQuery.bindValue(":id", bookId);
+        if (!reserveQuery.exec() || reserveQuery.numRowsAffected() != 1) {
+            qDebug() << "Book with ID" << bookId << "is not available" << reserveQuery.lastError().text();
+            m_db.rollback();
+            return false;
+        }
+
+        loanQuery.bindValue(":book_id", bookId);
+        loanQuery.bindValue(":issue_date", issueDate);
+        loanQuery.bindValue(":issued_at", issuedAt);
+        loanQuery.bindValue(":due_at", dueAt);
+        loanQuery.bindValue(":reader_id", readerId);
+        if (!loanQuery.exec() || loanQuery.numRowsAffected() != 1) {
+            qDebug() << "Issue book error for book ID" << bookId << "to reader ID" << readerId << ":"
+                     << loanQuery.lastError().text();
+            m_db.rollback();
+            return false;
+        }
     }
 
-    // Обновляем статус книги
-    query.prepare("UPDATE books SET available = 0 WHERE id = :id");
-    query.bindValue(":id", bookId);
-    if (!query.exec()) {
-        qDebug() << "Update book availability error:" << query.lastError().text();
+    if (!m_db.commit()) {
+        qDebug() << "Commit failed for issuing books:" << m_db.lastError().text();
+        m_db.rollback();
         return false;
     }
-
-    qDebug() << "Book issued successfully: book ID" << bookId << "to reader ID" << readerId;
+    m_cache->invalidate();
+    qDebug() << "Issued" << bookIds.size() << "books to reader ID" << readerId;
+    for (int bookId : bookIds) {
+        emit loanChanged(bookId);
+    }
     return true;
 }
 
@@ -504,12 +2076,24 @@ bool Database::returnBook(int bookId)
         return false;
     }
 
-    // Удаляем запись из loans
-    QSqlQuery query;
+    if (!m_db.transaction()) {
+        qDebug() << "Return book error: cannot start transaction:" << m_db.lastError().text();
+        return false;
+    }
+
+    // Удаляем запись из loans. Книга, которая не выдана, не возвращается: иначе повторный
+    // возврат сообщал бы об успехе, а книга без выдачи становилась бы доступной
+    QSqlQuery query(m_db);
     query.prepare("DELETE FROM loans WHERE book_id = :id");
     query.bindValue(":id", bookId);
     if (!query.exec()) {
         qDebug() << "Return book error (delete loan):" << query.lastError().text();
+        m_db.rollback();
+        return false;
+    }
+    if (query.numRowsAffected() != 1) {
+        qDebug() << "Return book error: book ID" << bookId << "is not on loan";
+        m_db.rollback();
         return false;
     }
 
@@ -518,9 +2102,133 @@ bool Database::returnBook(int bookId)
     query.bindValue(":id", bookId);
     if (!query.exec()) {
         qDebug() << "Update book availability error:" << query.lastError().text();
+        m_db.rollback();
         return false;
     }
 
+    if (!m_db.commit()) {
+        qDebug() << "Commit failed for book return:" << m_db.lastError().text();
+        m_db.rollback();
+        return false;
+    }
+    m_cache->invalidate();
     qDebug() << "Book returned successfully: book ID" << bookId;
+    emit loanChanged(bookId);
     return true;
 }
+
+QVariantList Database::overdueLoans(int limit)
+{
+    QVariantList loans;
+    if (!m_db.isOpen()) {
+        qDebug() << "Overdue loans error: database is not open";
+        return loans;
+    }
+
+    // Открытые выдачи лежат в loans, поэтому просрочка — это диапазон по idx_loans_due_at,
+    // а не проход по всей истории
+    const qint64 now = QDateTime::currentSecsSinceEpoch();
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+    query.prepare("SELECT l.book_id, b.title, l.reader_id, r.name AS reader_name, r.contact, l.issued_at, l.due_at "
+                  "FROM loans l "
+                  "JOIN books b ON b.id = l.book_id "
+                  "LEFT JOIN readers r ON r.id = l.reader_id "
+                  "WHERE l.due_at < :now "
+                  "ORDER BY l.due_at LIMIT :limit");
+    query.bindValue(":now", now);
+    query.bindValue(":limit", clampPageSize(limit));
+
+    if (!query.exec()) {
+        qDebug() << "Overdue loans error:" << query.lastError().text();
+        return loans;
+    }
+
+    while (query.next()) {
+        QVariantMap loan;
+        loan["book_id"] = query.value(0);
+        loan["title"] = query.value(1);
+        loan["reader_id"] = query.value(2);
+        loan["reader_name"] = query.value(3).toString();
+        loan["contact"] = query.value(4).toString();
+        loan["issued_at"] = QDateTime::fromSecsSinceEpoch(query.value(5).toLongLong());
+        loan["due_at"] = QDateTime::fromSecsSinceEpoch(query.value(6).toLongLong());
+        loan["days_overdue"] = int((now - query.value(6).toLongLong()) / SecondsPerDay);
+        loans.append(loan);
+    }
+    qDebug() << "Found" << loans.size() << "overdue loans";
+    return loans;
+}
+
+QVariantList Database::readerLoanHistory(int readerId, int limit)
+{
+    QVariantList loans;
+    if (!m_db.isOpen()) {
+        qDebug() << "Reader loan history error: database is not open";
+        return loans;
+    }
+
+    // idx_loan_history_reader отдаёт выдачи читателя уже упорядоченными по времени
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+    query.prepare("SELECT h.book_id, b.title, h.issued_at, h.due_at, h.returned_at "
+                  "FROM loan_history h "
+                  "LEFT JOIN books b ON b.id = h.book_id "
+                  "WHERE h.reader_id = :reader_id "
+                  "ORDER BY h.issued_at DESC LIMIT :limit");
+    query.bindValue(":reader_id", readerId);
+    query.bindValue(":limit", clampPageSize(limit));
+
+    if (!query.exec()) {
+        qDebug() << "Reader loan history error for reader ID" << readerId << ":" << query.lastError().text();
+        return loans;
+    }
+
+    while (query.next()) {
+        QVariantMap loan;
+        loan["book_id"] = query.value(0);
+        // Книга могла быть удалена, а её выдачи остаются в истории
+        loan["title"] = query.value(1).toString();
+        loan["issued_at"] = QDateTime::fromSecsSinceEpoch(query.value(2).toLongLong());
+        loan["due_at"] = QDateTime::fromSecsSinceEpoch(query.value(3).toLongLong());
+        loan["returned_at"] = query.value(4).isNull() ? QVariant()
+                                                      : QDateTime::fromSecsSinceEpoch(query.value(4).toLongLong());
+        loans.append(loan);
+    }
+    qDebug() << "Retrieved" << loans.size() << "history loans for reader ID" << readerId;
+    return loans;
+}
+
+QVariantList Database::loansPerDay(const QDateTime &from, const QDateTime &to)
+{
+    QVariantList days;
+    if (!m_db.isOpen()) {
+        qDebug() << "Loans per day error: database is not open";
+        return days;
+    }
+
+    // Сутки — календарные дни местного часового пояса: смещение берётся для каждой выдачи,
+    // поэтому границы не съезжают после перехода на летнее время. Группировка по выражению
+    // от issued_at читает только idx_loan_history_issued_at, не обращаясь к самой таблице
+    QSqlQuery query(m_db);
+    query.setForwardOnly(true);
+    query.prepare("SELECT date(issued_at, 'unixepoch', 'localtime') AS day, COUNT(*) "
+                  "FROM loan_history "
+                  "WHERE issued_at >= :from AND issued_at < :to "
+                  "GROUP BY day ORDER BY day");
+    query.bindValue(":from", from.toSecsSinceEpoch());
+    query.bindValue(":to", to.toSecsSinceEpoch());
+
+    if (!query.exec()) {
+        qDebug() << "Loans per day error:" << query.lastError().text();
+        return days;
+    }
+
+    while (query.next()) {
+        QVariantMap day;
+        day["date"] = QDate::fromString(query.value(0).toString(), Qt::ISODate);
+        day["count"] = query.value(1).toInt();
+        days.append(day);
+    }
+    return days;
+}
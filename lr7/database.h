@@ -6,6 +6,57 @@
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QVariantList>
+#include <QDateTime>
+#include <QVector>
+#include <functional>
+#include "bookexporter.h"
+
+class QueryCache;
+
+// Параметры фильтрации списка книг (общие для поиска, постраничной выборки и подсчёта).
+// searchTerm ищется подстрокой (LIKE) в названии, авторе и жанре, а при fullText — по началам
+// слов через полнотекстовый индекс; без FTS5 в сборке SQLite остаётся поиск подстроки
+struct BookFilter
+{
+    QString searchTerm;
+    bool fullText = false;
+    int minYear = 0;
+    int maxYear = 0;
+    bool onlyAvailable = false;
+    QString author;
+    QString genre;
+};
+
+// Строка списка книг: столбцы id, title, author, year, genre, available, reader_name
+struct Book
+{
+    int id = 0;
+    QString title;
+    QString author;
+    int year = 0;
+    QString genre;
+    bool available = false;
+    QString readerName;
+};
+
+// Строка списка читателей: столбцы id, name, contact
+struct Reader
+{
+    int id = 0;
+    QString name;
+    QString contact;
+};
+
+// Настройки соединения SQLite
+struct DatabaseOptions
+{
+    bool readOnly = false;
+    // В режиме WAL NORMAL сохраняет целостность базы и не делает fsync на каждую фиксацию
+    QString synchronous = "NORMAL";
+    int cacheSizeKiB = 64 * 1024;
+    qint64 mmapSize = 256LL * 1024 * 1024;
+    int busyTimeoutMs = 5000;
+};
 
 class Database : public QObject
 {
@@ -14,17 +65,61 @@ public:
     explicit Database(QObject *parent = nullptr);
     ~Database();
 
-    bool connectToDatabase(const QString &path);
+    bool connectToDatabase(const QString &path, const QString &connectionName,
+                           const DatabaseOptions &options = DatabaseOptions());
     void closeDatabase();
 
     // Методы для книг
-    Q_INVOKABLE bool addBook(const QString &title, const QString &author, int year, const QString &genre, bool available);
-    Q_INVOKABLE bool updateBook(int id, const QString &title, const QString &author, int year, const QString &genre, bool available);
+    // Доступность книги меняют только выдача и возврат: она следует из записи в loans,
+    // поэтому новая книга всегда доступна
+    Q_INVOKABLE bool addBook(const QString &title, const QString &author, int year, const QString &genre);
+    Q_INVOKABLE bool updateBook(int id, const QString &title, const QString &author, int year, const QString &genre);
     Q_INVOKABLE bool deleteBook(int id);
     Q_INVOKABLE QVariantList getAllBooks();
     Q_INVOKABLE QVariantList searchBooks(const QString &searchTerm);
+    // Полнотекстовый поиск с ранжированием по релевантности и префиксным совпадением слов.
+    // Остальные поиски, кроме фильтра с BookFilter::fullText, ищут подстроку; без FTS5 этот метод
+    // сводится к searchBooks
+    Q_INVOKABLE QVariantList searchBooksRanked(const QString &searchTerm, int limit);
     Q_INVOKABLE QVariantList searchBooksAdvanced(const QString &searchTerm, int minYear, int maxYear, bool onlyAvailable, const QString &author, const QString &genre);
     Q_INVOKABLE bool exportToCSV(const QString &filePath);
+    Q_INVOKABLE bool exportToJSONL(const QString &filePath);
+    // Потоковая выгрузка всех книг; progress и cancelled вызываются из потока выгрузки
+    bool exportBooks(const QString &filePath, BookExporter::Format format,
+                     const std::function<void(qint64)> &progress = std::function<void(qint64)>(),
+                     const std::function<bool()> &cancelled = std::function<bool()>());
+
+    // Постраничная выборка книг: следующая страница после последней показанной (title, id).
+    // afterId <= 0 означает первую страницу.
+    Q_INVOKABLE QVariantList getBooksPage(const QString &afterTitle, int afterId, int pageSize);
+    Q_INVOKABLE QVariantList searchBooksPage(const QString &searchTerm, int minYear, int maxYear, bool onlyAvailable,
+                                             const QString &author, const QString &genre,
+                                             const QString &afterTitle, int afterId, int pageSize);
+    Q_INVOKABLE int countBooks(const QString &searchTerm, int minYear, int maxYear, bool onlyAvailable,
+                               const QString &author, const QString &genre);
+
+    // Снимок базы без остановки приложения: копия пишется во временный файл рядом с targetPath
+    // и подменяет его только целиком. С LABA77_SQLITE_BACKUP_API используется Online Backup API
+    // порциями по pagesPerStep страниц, иначе база присоединяется к снимку и таблицы копируются
+    // одной транзакцией порциями по pagesPerStep строк. После каждой порции вызываются
+    // progress(copied, total) — страницы или строки соответственно — и cancelled, в потоке копирования
+    bool backupTo(const QString &targetPath,
+                  const std::function<void(int, int)> &progress = std::function<void(int, int)>(),
+                  const std::function<bool()> &cancelled = std::function<bool()>(),
+                  int pagesPerStep = DefaultBackupPagesPerStep);
+    // Заменяет содержимое базы снимком sourcePath тем же способом, что и backupTo.
+    // Снимок проверяется до копирования; после восстановления схема доводится до текущей версии
+    bool restoreFrom(const QString &sourcePath,
+                     const std::function<void(int, int)> &progress = std::function<void(int, int)>(),
+                     const std::function<bool()> &cancelled = std::function<bool()>(),
+                     int pagesPerStep = DefaultBackupPagesPerStep);
+    // Сжатая дефрагментированная копия базы (VACUUM INTO); исходный файл не меняется
+    Q_INVOKABLE bool compactTo(const QString &targetPath);
+
+    // Массовый импорт из CSV (строка заголовка обязательна): один подготовленный запрос,
+    // фиксация пачками по batchSize строк, прогресс — сигнал importProgress
+    Q_INVOKABLE bool importBooksFromCSV(const QString &filePath, int batchSize = DefaultImportBatchSize);
+    Q_INVOKABLE bool importReadersFromCSV(const QString &filePath, int batchSize = DefaultImportBatchSize);
 
     // Методы для читателей
     Q_INVOKABLE bool addReader(const QString &name, const QString &contact);
@@ -33,11 +128,103 @@ public:
     Q_INVOKABLE QVariantList getAllReaders();
 
     // Методы для выдачи/возврата книг
-    Q_INVOKABLE bool issueBook(int bookId, int readerId);
+    Q_INVOKABLE bool issueBook(int bookId, int readerId, int loanDays = DefaultLoanDays);
+    // Выдача стопки книг одному читателю одной транзакцией: либо все книги, либо ни одной
+    Q_INVOKABLE bool issueBooks(int readerId, const QVariantList &bookIds, int loanDays = DefaultLoanDays);
     Q_INVOKABLE bool returnBook(int bookId);
 
+    // Аналитика выдач по времени (целые секунды эпохи в loans и loan_history).
+    // Просроченные выдачи: book_id, title, reader_id, reader_name, contact, issued_at, due_at, days_overdue
+    Q_INVOKABLE QVariantList overdueLoans(int limit = MaxPageSize);
+    // Выдачи читателя от новых к старым, включая возвращённые: book_id, title, issued_at, due_at, returned_at
+    Q_INVOKABLE QVariantList readerLoanHistory(int readerId, int limit = DefaultPageSize);
+    // Число выдач по дням местного часового пояса в [from, to): date, count; дни без выдач пропускаются
+    Q_INVOKABLE QVariantList loansPerDay(const QDateTime &from, const QDateTime &to);
+
+    // Выполненные запросы страниц для моделей представления.
+    // Столбцы книг: id, title, author, year, genre, available, reader_name.
+    // Столбцы читателей: id, name, contact.
+    QSqlQuery queryBooksPage(const BookFilter &filter, const QString &afterTitle, int afterId, int pageSize);
+    QSqlQuery queryReadersPage(const QString &afterName, int afterId, int pageSize);
+    // Те же столбцы для отдельных строк: книги, не прошедшие фильтр или удалённые, не возвращаются
+    QSqlQuery queryBooksById(const BookFilter &filter, const QVector<int> &ids);
+    QSqlQuery queryReadersById(const QVector<int> &ids);
+    int countBooksMatching(const BookFilter &filter);
+
+    // Разбор результатов: индексы столбцов по имени находятся один раз на запрос, а не на строку
+    static QVector<Book> readBooks(QSqlQuery &query);
+    static QVector<Reader> readReaders(QSqlQuery &query);
+    // Представление для QML: список QVariantMap с теми же ключами, что и имена столбцов
+    static QVariantList toVariantList(const QVector<Book> &books);
+    static QVariantList toVariantList(const QVector<Reader> &readers);
+    int countReaders();
+
+    // Сводные счётчики книг: total и срезы genre, author, decade, available — списки { value, count }.
+    // Без фильтра читаются из поддерживаемой триггерами таблицы book_facets, с фильтром
+    // считаются по отобранным книгам. limit — число значений в срезе, <= 0 — все значения
+    Q_INVOKABLE QVariantMap facetCounts(const QString &searchTerm, int minYear, int maxYear, bool onlyAvailable,
+                                        const QString &author, const QString &genre, int limit = DefaultFacetLimit);
+    QVariantMap facetCountsMatching(const BookFilter &filter, int limit);
+
+    // Счётчики общего кэша списочных запросов: hits, misses, hitRate, entries, rows, generation
+    Q_INVOKABLE QVariantMap cacheStats() const;
+
+    static const int DefaultPageSize = 50;
+    static const int MaxPageSize = 1000;
+    static const int DefaultImportBatchSize = 1000;
+    static const int DefaultFacetLimit = 20;
+    static const int DefaultLoanDays = 14;
+    static const int DefaultBackupPagesPerStep = 1024;
+    static const int SecondsPerDay = 86400;
+
+signals:
+    // Построчные уведомления об изменениях, выполненных через это соединение,
+    // испускаются после фиксации транзакции. Массовый импорт сообщает только importFinished.
+    void bookInserted(int bookId);
+    void bookUpdated(int bookId);
+    void bookDeleted(int bookId);
+    // Изменилась выдача книги или имя читателя, которому она выдана
+    void loanChanged(int bookId);
+    void readerInserted(int readerId);
+    void readerUpdated(int readerId);
+    void readerDeleted(int readerId);
+
+    // Содержимое базы целиком заменено снимком: загруженные списки нужно перечитать
+    void databaseRestored();
+
+    void importProgress(const QString &filePath, int rowsImported);
+    void importFinished(const QString &filePath, bool success, int rowsImported);
+
 private:
+    using RowBinder = std::function<void(QSqlQuery &query, const QStringList &values)>;
+
+    bool importFromCSV(const QString &filePath, int batchSize, const QStringList &columns,
+                       const QString &insertSql, const RowBinder &bindRow);
+    bool importCsvRows(const QString &filePath, int batchSize, const QStringList &columns,
+                       const QString &insertSql, const RowBinder &bindRow, int &rowsImported);
+
+    bool issueBookList(int readerId, const QVector<int> &bookIds, int loanDays);
+    QVector<int> booksOnLoanTo(int readerId);
+    static QString idList(const QVector<int> &ids);
+    QVariantList fetchBooksPage(const BookFilter &filter, const QString &afterTitle, int afterId, int pageSize);
+    static int clampPageSize(int pageSize);
+    bool usesFullText(const BookFilter &filter) const;
+    QString bookFilterClause(const BookFilter &filter) const;
+    void bindBookFilter(QSqlQuery &query, const BookFilter &filter) const;
+    static bool isEmptyFilter(const BookFilter &filter);
+    void applyPragmas(const DatabaseOptions &options);
+    int schemaVersion();
+    bool migrateSchema();
+    bool hasFullTextIndex();
+    static QString fullTextMatchExpression(const QString &searchTerm);
+    bool vacuumInto(const QString &path);
+    bool validateSnapshot(const QString &path);
+    static bool replaceWithSnapshot(const QString &snapshotPath, const QString &targetPath);
+
     QSqlDatabase m_db;
+    // Кэш выборок, общий для всех соединений с этим файлом базы
+    QueryCache *m_cache;
+    bool m_hasFullText;
 };
 
 #endif // DATABASE_H
@@ -0,0 +1,67 @@
+#include "keysetmodel.h"
+
+KeysetModel::KeysetModel(QObject *parent)
+    : QAbstractListModel(parent), m_exhausted(true), m_fetching(false), m_generation(0), m_totalCount(0)
+{
+}
+
+bool KeysetModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && !m_exhausted;
+}
+
+void KeysetModel::fetchMore(const QModelIndex &parent)
+{
+    if (parent.isValid() || m_exhausted || m_fetching) {
+        return;
+    }
+    requestPage(false);
+}
+
+void KeysetModel::reload()
+{
+    beginResetModel();
+    clearRows();
+    ++m_generation;
+    m_exhausted = false;
+    m_fetching = true;
+    endResetModel();
+
+    requestPage(true);
+}
+
+int KeysetModel::totalCount() const
+{
+    return m_totalCount;
+}
+
+void KeysetModel::setTotalCount(int totalCount)
+{
+    if (totalCount != m_totalCount) {
+        m_totalCount = totalCount;
+        emit totalCountChanged();
+    }
+}
+
+int KeysetModel::compareKeys(const QString &left, const QString &right)
+{
+    // Сравнение по месту, без перекодирования в UTF-8 на каждом шаге сортировки.
+    // Порядок кодовых единиц UTF-16 расходится с порядком кодовых точек только на суррогатах:
+    // символы выше U+FFFF должны идти после U+E000..U+FFFF, поэтому диапазоны меняются местами
+    const QChar *l = left.constData();
+    const QChar *r = right.constData();
+    const int length = qMin(left.size(), right.size());
+    for (int i = 0; i < length; ++i) {
+        int a = l[i].unicode();
+        int b = r[i].unicode();
+        if (a == b) {
+            continue;
+        }
+        if (a >= 0xD800 && b >= 0xD800) {
+            a = a >= 0xE000 ? a - 0x800 : a + 0x2000;
+            b = b >= 0xE000 ? b - 0x800 : b + 0x2000;
+        }
+        return a < b ? -1 : 1;
+    }
+    return left.size() == right.size() ? 0 : (left.size() < right.size() ? -1 : 1);
+}
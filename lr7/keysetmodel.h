@@ -0,0 +1,305 @@
+#ifndef KEYSETMODEL_H
+#define KEYSETMODEL_H
+
+#include <QAbstractListModel>
+#include <QDebug>
+#include <QHash>
+#include <QVector>
+#include <algorithm>
+#include <functional>
+#include "asyncdatabase.h"
+
+// Общая часть моделей списков для ListView: строки подгружаются страницами через canFetchMore/fetchMore,
+// totalCount показывает размер всего списка в базе
+class KeysetModel : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_PROPERTY(int totalCount READ totalCount NOTIFY totalCountChanged)
+public:
+    explicit KeysetModel(QObject *parent = nullptr);
+
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+
+    Q_INVOKABLE void reload();
+
+    int totalCount() const;
+
+signals:
+    void totalCountChanged();
+
+protected:
+    // Запрос следующей страницы; withCount — заодно пересчитать totalCount
+    virtual void requestPage(bool withCount) = 0;
+    virtual void clearRows() = 0;
+    void setTotalCount(int totalCount);
+
+    // Порядок ORDER BY по тексту: SQLite (BINARY) сравнивает строки побайтно в UTF-8,
+    // что совпадает с порядком кодовых точек
+    static int compareKeys(const QString &left, const QString &right);
+
+    bool m_exhausted;
+    bool m_fetching;
+    // Меняется при перезагрузке, чтобы не применять перечитанные строки к новому списку
+    int m_generation;
+
+private:
+    int m_totalCount;
+};
+
+// Строки, упорядоченные так же, как keyset-запрос в базе: ORDER BY COALESCE(Key, ''), id.
+// Изменения в базе применяются точечно: перечитываются только изменённые строки
+template <typename Row, QString Row::*Key>
+class KeysetListModel : public KeysetModel
+{
+public:
+    // name — ключ вытеснения фоновых запросов модели и её имя в журнале
+    KeysetListModel(AsyncDatabase *database, const QString &name, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+
+protected:
+    // Результат фонового запроса: строки и, если запрошено, общее количество
+    struct Page
+    {
+        int totalCount = -1;
+        QVector<Row> rows;
+    };
+    using Query = std::function<Page(Database *)>;
+
+    // Запросы выполняются в потоке БД, поэтому захватывают копии нужного состояния модели.
+    // Страница после строки (afterKey, afterId); afterId <= 0 — первая страница
+    virtual Query pageQuery(const QString &afterKey, int afterId, bool withCount) const = 0;
+    // Перечитывание строк ids, которые всё ещё входят в список
+    virtual Query refreshQuery(const QVector<int> &ids, bool withCount) const = 0;
+
+    // Строка id изменилась в базе. countedBefore — учитывалась ли она в totalCount
+    // до изменения: 1 — да, 0 — нет, -1 — неизвестно, нужен пересчёт
+    void markChanged(int id, int countedBefore);
+    int indexOfId(int id) const;
+    const QVector<Row> &rows() const;
+
+private:
+    void requestPage(bool withCount) override;
+    void clearRows() override;
+    void applyPage(const Page &page);
+    void requestRefresh();
+    void applyRefresh(const QVector<int> &ids, const Page &refresh);
+    void placeRow(int index, const Row &row);
+    void insertRowAt(int position, const Row &row);
+    void removeRowAt(int index);
+    static bool sortsBefore(const Row &left, const Row &right);
+
+    AsyncDatabase *m_database;
+    QString m_name;
+    QVector<Row> m_rows;
+    // Позиция строки по id: уведомление об изменении не ищет строку проходом по списку
+    QHash<int, int> m_indexById;
+    // Изменённые строки, ожидающие перечитывания, и их countedBefore
+    QHash<int, int> m_pending;
+};
+
+template <typename Row, QString Row::*Key>
+KeysetListModel<Row, Key>::KeysetListModel(AsyncDatabase *database, const QString &name, QObject *parent)
+    : KeysetModel(parent), m_database(database), m_name(name)
+{
+}
+
+template <typename Row, QString Row::*Key>
+int KeysetListModel<Row, Key>::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return m_rows.size();
+}
+
+template <typename Row, QString Row::*Key>
+const QVector<Row> &KeysetListModel<Row, Key>::rows() const
+{
+    return m_rows;
+}
+
+template <typename Row, QString Row::*Key>
+void KeysetListModel<Row, Key>::clearRows()
+{
+    m_rows.clear();
+    m_indexById.clear();
+    m_pending.clear();
+}
+
+template <typename Row, QString Row::*Key>
+void KeysetListModel<Row, Key>::requestPage(bool withCount)
+{
+    m_fetching = true;
+
+    // Продолжаем после последней загруженной строки (keyset по Key, id)
+    QString afterKey;
+    int afterId = 0;
+    if (!m_rows.isEmpty()) {
+        afterKey = m_rows.last().*Key;
+        afterId = m_rows.last().id;
+    }
+
+    // Новый запрос модели вытесняет ещё не доставленный старый
+    m_database->submit<Page>(this, m_name, pageQuery(afterKey, afterId, withCount), [this](const Page &page) {
+        applyPage(page);
+    });
+}
+
+template <typename Row, QString Row::*Key>
+void KeysetListModel<Row, Key>::applyPage(const Page &page)
+{
+    m_fetching = false;
+    if (page.totalCount >= 0) {
+        setTotalCount(page.totalCount);
+    }
+
+    if (page.rows.size() < Database::DefaultPageSize) {
+        m_exhausted = true;
+    }
+    if (page.rows.isEmpty()) {
+        return;
+    }
+
+    beginInsertRows(QModelIndex(), m_rows.size(), m_rows.size() + page.rows.size() - 1);
+    m_indexById.reserve(m_rows.size() + page.rows.size());
+    for (const Row &row : page.rows) {
+        m_indexById.insert(row.id, m_rows.size());
+        m_rows.append(row);
+    }
+    endInsertRows();
+    qDebug() << m_name << "fetched" << page.rows.size() << "rows, total loaded:" << m_rows.size();
+}
+
+template <typename Row, QString Row::*Key>
+void KeysetListModel<Row, Key>::markChanged(int id, int countedBefore)
+{
+    // Для totalCount важно состояние до первого из нескольких изменений подряд
+    if (!m_pending.contains(id)) {
+        m_pending.insert(id, countedBefore);
+    }
+    requestRefresh();
+}
+
+template <typename Row, QString Row::*Key>
+void KeysetListModel<Row, Key>::requestRefresh()
+{
+    // Каждый запрос перечитывает все ожидающие строки, поэтому вытесненный предыдущий
+    // запрос ничего не теряет, а серия изменений сливается в один запрос
+    QVector<int> ids;
+    ids.reserve(m_pending.size());
+    bool withCount = false;
+    for (auto it = m_pending.cbegin(); it != m_pending.cend(); ++it) {
+        ids.append(it.key());
+        if (it.value() < 0) {
+            withCount = true;
+        }
+    }
+    int generation = m_generation;
+
+    m_database->submit<Page>(this, m_name + "Refresh", refreshQuery(ids, withCount),
+                             [this, ids, generation](const Page &refresh) {
+        if (generation == m_generation) {
+            applyRefresh(ids, refresh);
+        }
+    });
+}
+
+template <typename Row, QString Row::*Key>
+void KeysetListModel<Row, Key>::applyRefresh(const QVector<int> &ids, const Page &refresh)
+{
+    QHash<int, Row> found;
+    for (const Row &row : refresh.rows) {
+        found.insert(row.id, row);
+    }
+
+    int countDelta = 0;
+    for (int id : ids) {
+        int countedBefore = m_pending.take(id);
+        int index = indexOfId(id);
+        auto it = found.constFind(id);
+        if (it == found.cend()) {
+            // Строка удалена или больше не проходит фильтр
+            if (index >= 0) {
+                removeRowAt(index);
+            }
+            if (countedBefore > 0) {
+                --countDelta;
+            }
+        } else {
+            placeRow(index, it.value());
+            if (countedBefore == 0) {
+                ++countDelta;
+            }
+        }
+    }
+
+    setTotalCount(refresh.totalCount >= 0 ? refresh.totalCount : totalCount() + countDelta);
+    qDebug() << m_name << "refreshed" << ids.size() << "rows";
+}
+
+template <typename Row, QString Row::*Key>
+void KeysetListModel<Row, Key>::placeRow(int index, const Row &row)
+{
+    if (index >= 0) {
+        // Порядок не нарушен — достаточно обновить данные строки. Последняя строка при
+        // недогруженном списке задаёт продолжение keyset, поэтому сдвигать её дальше нельзя.
+        bool afterPrevious = index == 0 || sortsBefore(m_rows.at(index - 1), row);
+        bool beforeNext = index + 1 < m_rows.size() ? sortsBefore(row, m_rows.at(index + 1))
+                                                    : m_exhausted || !sortsBefore(m_rows.at(index), row);
+        if (afterPrevious && beforeNext) {
+            m_rows[index] = row;
+            emit dataChanged(this->index(index), this->index(index));
+            return;
+        }
+        removeRowAt(index);
+    }
+
+    // Строка за последней загруженной придёт со следующими страницами
+    if (!m_exhausted && (m_rows.isEmpty() || sortsBefore(m_rows.last(), row))) {
+        return;
+    }
+    int position = std::lower_bound(m_rows.cbegin(), m_rows.cend(), row, sortsBefore) - m_rows.cbegin();
+    insertRowAt(position, row);
+}
+
+template <typename Row, QString Row::*Key>
+void KeysetListModel<Row, Key>::insertRowAt(int position, const Row &row)
+{
+    beginInsertRows(QModelIndex(), position, position);
+    m_rows.insert(position, row);
+    // Строки после вставленной сдвигаются на одну позицию
+    for (int i = position; i < m_rows.size(); ++i) {
+        m_indexById.insert(m_rows.at(i).id, i);
+    }
+    endInsertRows();
+}
+
+template <typename Row, QString Row::*Key>
+void KeysetListModel<Row, Key>::removeRowAt(int index)
+{
+    beginRemoveRows(QModelIndex(), index, index);
+    m_indexById.remove(m_rows.at(index).id);
+    m_rows.remove(index);
+    for (int i = index; i < m_rows.size(); ++i) {
+        m_indexById.insert(m_rows.at(i).id, i);
+    }
+    endRemoveRows();
+}
+
+template <typename Row, QString Row::*Key>
+int KeysetListModel<Row, Key>::indexOfId(int id) const
+{
+    return m_indexById.value(id, -1);
+}
+
+template <typename Row, QString Row::*Key>
+bool KeysetListModel<Row, Key>::sortsBefore(const Row &left, const Row &right)
+{
+    // NULL из базы читается как пустая строка, что совпадает с COALESCE(Key, '')
+    int order = compareKeys(left.*Key, right.*Key);
+    return order < 0 || (order == 0 && left.id < right.id);
+}
+
+#endif // KEYSETMODEL_H
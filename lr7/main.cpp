@@ -1,7 +1,11 @@
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
 #include <QQmlContext>
-#include "database.h"
+#include <QStandardPaths>
+#include <QDir>
+#include "asyncdatabase.h"
+#include "bookmodel.h"
+#include "readermodel.h"
 
 int main(int argc, char *argv[])
 {
@@ -11,14 +15,46 @@ int main(int argc, char *argv[])
     QCoreApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
     QGuiApplication app(argc, argv);
 
-    Database db;
-    if (!db.connectToDatabase("/home/user/external_database.db")) {
+    // Путь к базе можно передать первым аргументом, иначе она лежит в каталоге данных приложения
+    QString databasePath;
+    if (app.arguments().size() > 1) {
+        databasePath = app.arguments().at(1);
+    } else {
+        QString dataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+        QDir().mkpath(dataDir);
+        databasePath = QDir(dataDir).filePath("library.db");
+    }
+    DatabaseOptions options;
+
+    // Чтение списков и экспорт идут через пул соединений только для чтения, любые изменения —
+    // через единственное пишущее соединение в потоке записи
+    AsyncDatabase asyncDb;
+    if (!asyncDb.open(databasePath, options)) {
         qCritical() << "Failed to connect to database!";
         return -1;
     }
 
+    BookModel bookModel(&asyncDb);
+    ReaderModel readerModel(&asyncDb);
+
+    // Изменения из QML и импорт применяются к загруженным строкам моделей без полной перезагрузки списков
+    QObject::connect(&asyncDb, &AsyncDatabase::bookInserted, &bookModel, &BookModel::onBookInserted);
+    QObject::connect(&asyncDb, &AsyncDatabase::bookUpdated, &bookModel, &BookModel::onBookChanged);
+    QObject::connect(&asyncDb, &AsyncDatabase::bookDeleted, &bookModel, &BookModel::onBookChanged);
+    QObject::connect(&asyncDb, &AsyncDatabase::loanChanged, &bookModel, &BookModel::onBookChanged);
+    QObject::connect(&asyncDb, &AsyncDatabase::readerInserted, &readerModel, &ReaderModel::onReaderInserted);
+    QObject::connect(&asyncDb, &AsyncDatabase::readerUpdated, &readerModel, &ReaderModel::onReaderChanged);
+    QObject::connect(&asyncDb, &AsyncDatabase::readerDeleted, &readerModel, &ReaderModel::onReaderChanged);
+    // Импорт и восстановление меняют таблицы целиком: списки перечитываются с текущим фильтром
+    QObject::connect(&asyncDb, &AsyncDatabase::importFinished, &bookModel, &BookModel::reload);
+    QObject::connect(&asyncDb, &AsyncDatabase::importFinished, &readerModel, &ReaderModel::reload);
+    QObject::connect(&asyncDb, &AsyncDatabase::databaseRestored, &bookModel, &BookModel::reload);
+    QObject::connect(&asyncDb, &AsyncDatabase::databaseRestored, &readerModel, &ReaderModel::reload);
+
     QQmlApplicationEngine engine;
-    engine.rootContext()->setContextProperty("database", &db);
+    engine.rootContext()->setContextProperty("asyncDatabase", &asyncDb);
+    engine.rootContext()->setContextProperty("bookModel", &bookModel);
+    engine.rootContext()->setContextProperty("readerModel", &readerModel);
 
     const QUrl url(QStringLiteral("Laba77/main.qml"));
     QObject::connect(&engine, &QQmlApplicationEngine::objectCreated,
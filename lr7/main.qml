@@ -44,7 +44,7 @@ ApplicationWindow {
 
                 TextField {
                     id: searchField
-                    placeholderText: "Поиск по названию, автору или жанру"
+                    placeholderText: "Поиск по словам в названии, авторе или жанре"
                     Layout.fillWidth: true
                     onTextChanged: refreshBookList()
                 }
@@ -55,16 +55,38 @@ ApplicationWindow {
                     onCheckedChanged: refreshBookList()
                 }
 
+                Label {
+                    text: "Всего: " + bookModel.totalCount
+                }
+
                 Button {
                     text: "Расширенный поиск"
                     onClicked: advancedSearchPopup.open()
                 }
 
                 Button {
-                    text: "Экспорт в CSV"
+                    text: "Экспорт"
                     onClicked: fileDialog.open()
                 }
 
+                Button {
+                    text: "Импорт из CSV"
+                    onClicked: {
+                        importFileDialog.importReaders = false
+                        importFileDialog.open()
+                    }
+                }
+
+                Button {
+                    text: "Резервная копия"
+                    onClicked: backupFileDialog.open()
+                }
+
+                Button {
+                    text: "Восстановить"
+                    onClicked: restoreFileDialog.open()
+                }
+
                 Button {
                     text: "Добавить книгу"
                     onClicked: {
@@ -73,7 +95,6 @@ ApplicationWindow {
                         authorField.text = ""
                         yearField.text = ""
                         genreField.text = ""
-                        availableCheckBox.checked = true
                         bookFormPopup.open()
                     }
                 }
@@ -91,7 +112,7 @@ ApplicationWindow {
                     height: parent.height
                     clip: true
                     spacing: 5
-                    model: ListModel { id: bookModel }
+                    model: bookModel
 
                     delegate: ItemDelegate {
                         width: bookListView.width
@@ -149,9 +170,12 @@ ApplicationWindow {
                                             currentBookId = id
                                             issueBookPopup.open()
                                         } else {
-                                            if (database.returnBook(id)) {
-                                                refreshBookList()
-                                            }
+                                            asyncDatabase.returnBook(id, function(success) {
+                                                if (!success) {
+                                                    resultPopup.text = "Ошибка при возврате книги"
+                                                    resultPopup.open()
+                                                }
+                                            })
                                         }
                                     }
                                 }
@@ -164,7 +188,6 @@ ApplicationWindow {
                                         authorField.text = author
                                         yearField.text = year
                                         genreField.text = genre
-                                        availableCheckBox.checked = available
                                         bookFormPopup.open()
                                     }
                                 }
@@ -194,6 +217,14 @@ ApplicationWindow {
                 Layout.rightMargin: 10
                 spacing: 10
 
+                Button {
+                    text: "Импорт из CSV"
+                    onClicked: {
+                        importFileDialog.importReaders = true
+                        importFileDialog.open()
+                    }
+                }
+
                 Button {
                     text: "Добавить читателя"
                     onClicked: {
@@ -217,7 +248,7 @@ ApplicationWindow {
                     height: parent.height
                     clip: true
                     spacing: 5
-                    model: ListModel { id: readerModel }
+                    model: readerModel
 
                     delegate: ItemDelegate {
                         width: readerListView.width
@@ -328,12 +359,6 @@ ApplicationWindow {
                 Layout.fillWidth: true
             }
 
-            CheckBox {
-                id: availableCheckBox
-                text: "Доступна"
-                checked: true
-            }
-
             RowLayout {
                 Button {
                     text: "Отмена"
@@ -345,23 +370,20 @@ ApplicationWindow {
                     text: currentBookId === -1 ? "Добавить" : "Сохранить"
                     Layout.fillWidth: true
                     onClicked: {
-                        if (currentBookId === -1) {
-                            if (database.addBook(titleField.text, authorField.text,
-                                               parseInt(yearField.text),
-                                               genreField.text,
-                                               availableCheckBox.checked)) {
-                                refreshBookList()
+                        var onSaved = function(success) {
+                            if (success) {
                                 bookFormPopup.close()
                             }
+                        }
+                        if (currentBookId === -1) {
+                            asyncDatabase.addBook(titleField.text, authorField.text,
+                                                  parseInt(yearField.text),
+                                                  genreField.text, onSaved)
                         } else {
-                            if (database.updateBook(currentBookId, titleField.text,
-                                                   authorField.text,
-                                                   parseInt(yearField.text),
-                                                   genreField.text,
-                                                   availableCheckBox.checked)) {
-                                refreshBookList()
-                                bookFormPopup.close()
-                            }
+                            asyncDatabase.updateBook(currentBookId, titleField.text,
+                                                     authorField.text,
+                                                     parseInt(yearField.text),
+                                                     genreField.text, onSaved)
                         }
                     }
                 }
@@ -408,16 +430,17 @@ ApplicationWindow {
                     Layout.fillWidth: true
                     onClicked: {
                         console.log("Confirmed deletion for book ID:", deleteBookPopup.bookId)
-                        if (database.deleteBook(deleteBookPopup.bookId)) {
-                            console.log("Book deleted successfully")
-                            refreshBookList()
-                            resultPopup.text = "Книга успешно удалена"
-                        } else {
-                            console.log("Failed to delete book")
-                            resultPopup.text = "Ошибка при удалении книги"
-                        }
+                        asyncDatabase.deleteBook(deleteBookPopup.bookId, function(success) {
+                            if (success) {
+                                console.log("Book deleted successfully")
+                                resultPopup.text = "Книга успешно удалена"
+                            } else {
+                                console.log("Failed to delete book")
+                                resultPopup.text = "Ошибка при удалении книги"
+                            }
+                            resultPopup.open()
+                        })
                         deleteBookPopup.close()
-                        resultPopup.open()
                     }
                 }
             }
@@ -455,15 +478,186 @@ ApplicationWindow {
 
     FileDialog {
         id: fileDialog
-        title: "Сохранить CSV"
-        nameFilters: ["CSV files (*.csv)"]
+        title: "Экспорт книг"
+        nameFilters: ["CSV files (*.csv)", "JSON Lines (*.jsonl)"]
         fileMode: FileDialog.SaveFile
         onAccepted: {
             var path = fileDialog.file.toString().replace("file://", "")
-            if (database.exportToCSV(path)) {
-                console.log("Exported to", path)
+            var format = path.toLowerCase().endsWith(".jsonl") ? "jsonl" : "csv"
+            exportPopup.rowsWritten = 0
+            exportPopup.totalRows = 0
+            exportPopup.requestId = asyncDatabase.exportBooks(path, format, function(success) {
+                console.log(success ? "Exported to " + path : "Export failed")
+                exportPopup.close()
+                resultPopup.text = success ? "Экспорт завершён" : "Ошибка экспорта"
+                resultPopup.open()
+            })
+            exportPopup.open()
+        }
+    }
+
+    Popup {
+        id: exportPopup
+        width: Math.min(window.width * 0.9, 300)
+        height: Math.min(window.height * 0.9, 150)
+        x: (window.width - width) / 2
+        y: (window.height - height) / 2
+        modal: true
+        closePolicy: Popup.NoAutoClose
+        padding: 10
+        property int requestId: -1
+        property real rowsWritten: 0
+        property real totalRows: 0
+
+        ColumnLayout {
+            anchors.fill: parent
+            spacing: 10
+
+            Label {
+                text: "Экспорт: " + exportPopup.rowsWritten + " из " + exportPopup.totalRows
+                Layout.fillWidth: true
+            }
+
+            ProgressBar {
+                from: 0
+                to: Math.max(exportPopup.totalRows, 1)
+                value: exportPopup.rowsWritten
+                Layout.fillWidth: true
+            }
+
+            Button {
+                text: "Отмена"
+                Layout.fillWidth: true
+                onClicked: {
+                    asyncDatabase.cancel(exportPopup.requestId)
+                    exportPopup.close()
+                }
+            }
+        }
+    }
+
+    FileDialog {
+        id: backupFileDialog
+        title: "Резервная копия базы"
+        nameFilters: ["SQLite database (*.db)"]
+        fileMode: FileDialog.SaveFile
+        onAccepted: {
+            var path = backupFileDialog.file.toString().replace("file://", "")
+            backupPopup.title = "Резервная копия"
+            backupPopup.copied = 0
+            backupPopup.total = 0
+            backupPopup.requestId = asyncDatabase.backupDatabase(path, function(success) {
+                backupPopup.close()
+                resultPopup.text = success ? "Резервная копия сохранена" : "Ошибка резервного копирования"
+                resultPopup.open()
+            })
+            backupPopup.open()
+        }
+    }
+
+    FileDialog {
+        id: restoreFileDialog
+        title: "Восстановление базы"
+        nameFilters: ["SQLite database (*.db)"]
+        fileMode: FileDialog.OpenFile
+        onAccepted: {
+            var path = restoreFileDialog.file.toString().replace("file://", "")
+            backupPopup.title = "Восстановление"
+            backupPopup.copied = 0
+            backupPopup.total = 0
+            backupPopup.requestId = asyncDatabase.restoreDatabase(path, function(success) {
+                backupPopup.close()
+                resultPopup.text = success ? "База восстановлена" : "Ошибка восстановления"
+                resultPopup.open()
+            })
+            backupPopup.open()
+        }
+    }
+
+    Popup {
+        id: backupPopup
+        width: Math.min(window.width * 0.9, 300)
+        height: Math.min(window.height * 0.9, 150)
+        x: (window.width - width) / 2
+        y: (window.height - height) / 2
+        modal: true
+        closePolicy: Popup.NoAutoClose
+        padding: 10
+        property string title: ""
+        property int requestId: -1
+        property int copied: 0
+        property int total: 0
+
+        ColumnLayout {
+            anchors.fill: parent
+            spacing: 10
+
+            Label {
+                text: backupPopup.title + ": " + backupPopup.copied + " из " + backupPopup.total
+                Layout.fillWidth: true
+            }
+
+            ProgressBar {
+                from: 0
+                to: Math.max(backupPopup.total, 1)
+                value: backupPopup.copied
+                Layout.fillWidth: true
+            }
+
+            Button {
+                text: "Отмена"
+                Layout.fillWidth: true
+                onClicked: {
+                    asyncDatabase.cancel(backupPopup.requestId)
+                    backupPopup.close()
+                }
+            }
+        }
+    }
+
+    FileDialog {
+        id: importFileDialog
+        title: "Импорт из CSV"
+        nameFilters: ["CSV files (*.csv)"]
+        fileMode: FileDialog.OpenFile
+        property bool importReaders: false
+        property int rowsImported: 0
+        onAccepted: {
+            var path = importFileDialog.file.toString().replace("file://", "")
+            var onFinished = function(success) {
+                resultPopup.text = success
+                        ? "Импортировано записей: " + importFileDialog.rowsImported
+                        : "Ошибка импорта (сохранено записей: " + importFileDialog.rowsImported + ")"
+                resultPopup.open()
+            }
+            rowsImported = 0
+            if (importReaders) {
+                asyncDatabase.importReadersFromCSV(path, 1000, onFinished)
             } else {
-                console.log("Export failed")
+                asyncDatabase.importBooksFromCSV(path, 1000, onFinished)
+            }
+        }
+    }
+
+    Connections {
+        target: asyncDatabase
+
+        function onImportProgress(filePath, rowsImported) {
+            console.log("Imported", rowsImported, "rows from", filePath)
+            importFileDialog.rowsImported = rowsImported
+        }
+
+        function onExportProgress(requestId, rowsWritten, totalRows) {
+            if (requestId === exportPopup.requestId) {
+                exportPopup.rowsWritten = rowsWritten
+                exportPopup.totalRows = totalRows
+            }
+        }
+
+        function onBackupProgress(requestId, copied, total) {
+            if (requestId === backupPopup.requestId) {
+                backupPopup.copied = copied
+                backupPopup.total = total
             }
         }
     }
@@ -533,11 +727,8 @@ ApplicationWindow {
                     onClicked: {
                         var minYear = minYearField.text ? parseInt(minYearField.text) : 0;
                         var maxYear = maxYearField.text ? parseInt(maxYearField.text) : 0;
-                        bookModel.clear()
-                        var books = database.searchBooksAdvanced(searchField.text, minYear, maxYear, availableFilterAdv.checked, authorFieldAdv.text, genreFieldAdv.text)
-                        for (var i = 0; i < books.length; i++) {
-                            bookModel.append(books[i])
-                        }
+                        bookModel.setFilter(searchField.text, minYear, maxYear, availableFilterAdv.checked,
+                                            authorFieldAdv.text, genreFieldAdv.text)
                         advancedSearchPopup.close()
                     }
                 }
@@ -588,16 +779,16 @@ ApplicationWindow {
                     text: currentReaderId === -1 ? "Добавить" : "Сохранить"
                     Layout.fillWidth: true
                     onClicked: {
-                        if (currentReaderId === -1) {
-                            if (database.addReader(readerNameField.text, readerContactField.text)) {
-                                refreshReaderList()
+                        var onSaved = function(success) {
+                            if (success) {
                                 readerFormPopup.close()
                             }
+                        }
+                        if (currentReaderId === -1) {
+                            asyncDatabase.addReader(readerNameField.text, readerContactField.text, onSaved)
                         } else {
-                            if (database.updateReader(currentReaderId, readerNameField.text, readerContactField.text)) {
-                                refreshReaderList()
-                                readerFormPopup.close()
-                            }
+                            asyncDatabase.updateReader(currentReaderId, readerNameField.text, readerContactField.text,
+                                                       onSaved)
                         }
                     }
                 }
@@ -644,16 +835,17 @@ ApplicationWindow {
                     Layout.fillWidth: true
                     onClicked: {
                         console.log("Confirmed deletion for reader ID:", deleteReaderPopup.readerId)
-                        if (database.deleteReader(deleteReaderPopup.readerId)) {
-                            console.log("Reader deleted successfully")
-                            refreshReaderList()
-                            resultPopup.text = "Читатель успешно удален"
-                        } else {
-                            console.log("Failed to delete reader")
-                            resultPopup.text = "Ошибка при удалении читателя"
-                        }
+                        asyncDatabase.deleteReader(deleteReaderPopup.readerId, function(success) {
+                            if (success) {
+                                console.log("Reader deleted successfully")
+                                resultPopup.text = "Читатель успешно удален"
+                            } else {
+                                console.log("Failed to delete reader")
+                                resultPopup.text = "Ошибка при удалении читателя"
+                            }
+                            resultPopup.open()
+                        })
                         deleteReaderPopup.close()
-                        resultPopup.open()
                     }
                 }
             }
@@ -672,14 +864,9 @@ ApplicationWindow {
 
         onOpened: {
             console.log("Opening issue book popup for book ID:", currentBookId)
-            readerComboModel.clear()
-            var readers = database.getAllReaders()
-            for (var i = 0; i < readers.length; i++) {
-                readerComboModel.append(readers[i])
-            }
-            if (readers.length > 0) {
+            if (readerComboBox.count > 0) {
                 readerComboBox.currentIndex = 0
-                currentReaderId = readers[0].id
+                currentReaderId = readerComboBox.valueAt(0)
             }
         }
 
@@ -696,7 +883,7 @@ ApplicationWindow {
             ComboBox {
                 id: readerComboBox
                 Layout.fillWidth: true
-                model: ListModel { id: readerComboModel }
+                model: readerModel
                 textRole: "name"
                 valueRole: "id"
                 onActivated: {
@@ -717,12 +904,13 @@ ApplicationWindow {
                     Layout.fillWidth: true
                     onClicked: {
                         console.log("Issuing book ID:", currentBookId, "to reader ID:", currentReaderId)
-                        if (database.issueBook(currentBookId, currentReaderId)) {
-                            refreshBookList()
-                            issueBookPopup.close()
-                        } else {
-                            console.log("Failed to issue book")
-                        }
+                        asyncDatabase.issueBook(currentBookId, currentReaderId, function(success) {
+                            if (success) {
+                                issueBookPopup.close()
+                            } else {
+                                console.log("Failed to issue book")
+                            }
+                        })
                     }
                 }
             }
@@ -731,20 +919,12 @@ ApplicationWindow {
 
     function refreshBookList() {
         console.log("Refreshing book list")
-        bookModel.clear()
-        var books = database.searchBooksAdvanced(searchField.text, 0, 0, availableFilter.checked, "", "")
-        for (var i = 0; i < books.length; i++) {
-            bookModel.append(books[i])
-        }
+        bookModel.setFilter(searchField.text, 0, 0, availableFilter.checked, "", "")
     }
 
     function refreshReaderList() {
         console.log("Refreshing reader list")
-        readerModel.clear()
-        var readers = database.getAllReaders()
-        for (var i = 0; i < readers.length; i++) {
-            readerModel.append(readers[i])
-        }
+        readerModel.reload()
     }
 
     Component.onCompleted: {
@@ -0,0 +1,95 @@
+#include "querycache.h"
+#include <QFileInfo>
+#include <QHash>
+#include <QMutexLocker>
+
+QueryCache &QueryCache::forDatabase(const QString &databasePath, const QString &connectionName)
+{
+    static QMutex mutex;
+    static QHash<QString, QueryCache *> caches;
+
+    // Разные записи пути к одному файлу должны давать один и тот же кэш
+    const bool inMemory = databasePath.isEmpty() || databasePath == QLatin1String(":memory:")
+                          || databasePath.startsWith(QLatin1String("file::memory:"));
+    const QString key = inMemory ? QChar(0x1f) + connectionName : QFileInfo(databasePath).absoluteFilePath();
+
+    QMutexLocker locker(&mutex);
+    QueryCache *&cache = caches[key];
+    if (!cache) {
+        cache = new QueryCache;
+    }
+    return *cache;
+}
+
+QueryCache::QueryCache()
+    : m_entries(DefaultMaxRows), m_generation(0), m_hits(0), m_misses(0)
+{
+}
+
+QString QueryCache::key(const char *method, const QVariantList &params)
+{
+    // Разделитель \x1f не встречается во вводе пользователя, поэтому ключи разных параметров не совпадут
+    QString result = QString::fromLatin1(method);
+    for (const QVariant &param : params) {
+        result += QChar(0x1f);
+        result += param.toString();
+    }
+    return result;
+}
+
+quint64 QueryCache::generation() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_generation;
+}
+
+bool QueryCache::lookup(const QString &key, QVariantList &rows)
+{
+    QMutexLocker locker(&m_mutex);
+    QVariantList *cached = m_entries.object(key);
+    if (!cached) {
+        ++m_misses;
+        return false;
+    }
+    ++m_hits;
+    // QVariantList неявно разделяемый: копия стоит одного счётчика ссылок
+    rows = *cached;
+    return true;
+}
+
+void QueryCache::insert(const QString &key, quint64 generation, const QVariantList &rows)
+{
+    QMutexLocker locker(&m_mutex);
+    // За время запроса прошла запись: результат мог устареть
+    if (generation != m_generation) {
+        return;
+    }
+    m_entries.insert(key, new QVariantList(rows), rows.size() + 1);
+}
+
+void QueryCache::invalidate()
+{
+    QMutexLocker locker(&m_mutex);
+    ++m_generation;
+    m_entries.clear();
+}
+
+void QueryCache::setMaxRows(int maxRows)
+{
+    QMutexLocker locker(&m_mutex);
+    m_entries.setMaxCost(maxRows);
+}
+
+QVariantMap QueryCache::stats() const
+{
+    QMutexLocker locker(&m_mutex);
+    QVariantMap result;
+    result["hits"] = m_hits;
+    result["misses"] = m_misses;
+    quint64 lookups = m_hits + m_misses;
+    result["hitRate"] = lookups ? double(m_hits) / double(lookups) : 0.0;
+    result["entries"] = m_entries.count();
+    result["rows"] = m_entries.totalCost();
+    result["generation"] = m_generation;
+    return result;
+}
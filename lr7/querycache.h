@@ -0,0 +1,50 @@
+#ifndef QUERYCACHE_H
+#define QUERYCACHE_H
+
+#include <QCache>
+#include <QMutex>
+#include <QString>
+#include <QVariantList>
+#include <QVariantMap>
+
+// LRU-кэш результатов списочных запросов Database.
+// Один экземпляр на файл базы, общий для всех его соединений (пишущего и пула читающих),
+// поэтому запись через любое соединение делает недействительными результаты, полученные
+// через остальные, а результаты другой базы того же процесса сюда не попадают.
+// invalidate() очищает кэш и увеличивает поколение; результат запроса, начатого
+// в старом поколении, в кэш уже не попадёт, даже если запрос завершился после записи.
+class QueryCache
+{
+public:
+    // Кэш базы databasePath; база в памяти есть только у своего соединения, поэтому для неё
+    // кэш выбирается по connectionName. Экземпляры живут до конца процесса
+    static QueryCache &forDatabase(const QString &databasePath, const QString &connectionName);
+
+    // Ключ из имени метода и нормализованных параметров запроса
+    static QString key(const char *method, const QVariantList &params);
+
+    // Поколение нужно взять до выполнения запроса и передать в insert
+    quint64 generation() const;
+    bool lookup(const QString &key, QVariantList &rows);
+    void insert(const QString &key, quint64 generation, const QVariantList &rows);
+    // Вызывается после каждой зафиксированной записи в базу
+    void invalidate();
+
+    // Ёмкость в строках результатов, а не в запросах: одна огромная выборка не вытесняет всё
+    void setMaxRows(int maxRows);
+    // hits, misses, hitRate, entries, rows, generation
+    QVariantMap stats() const;
+
+    static const int DefaultMaxRows = 200000;
+
+private:
+    QueryCache();
+
+    mutable QMutex m_mutex;
+    QCache<QString, QVariantList> m_entries;
+    quint64 m_generation;
+    quint64 m_hits;
+    quint64 m_misses;
+};
+
+#endif // QUERYCACHE_H
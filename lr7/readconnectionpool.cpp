@@ -0,0 +1,43 @@
+#include "readconnectionpool.h"
+#include <QDebug>
+
+ReadConnectionPool::ReadConnectionPool(const QString &path, int size, const DatabaseOptions &options)
+    : m_path(path), m_options(options), m_nextIndex(0)
+{
+    m_options.readOnly = true;
+    m_threads.setMaxThreadCount(qMax(1, size));
+    // Потоки не завершаются по простою, иначе вместе с ними закрывались бы соединения и их кэш страниц
+    m_threads.setExpiryTimeout(-1);
+}
+
+ReadConnectionPool::~ReadConnectionPool()
+{
+    // Потоки пула завершаются здесь, и QThreadStorage удаляет соединение каждого из них
+    // в его собственном потоке, пока хранилище ещё существует
+    m_threads.waitForDone();
+}
+
+void ReadConnectionPool::run(std::function<void(Database *)> job)
+{
+    m_threads.start([this, job]() {
+        job(connectionForCurrentThread());
+    });
+}
+
+int ReadConnectionPool::size() const
+{
+    return m_threads.maxThreadCount();
+}
+
+Database *ReadConnectionPool::connectionForCurrentThread()
+{
+    if (!m_connections.hasLocalData()) {
+        Database *database = new Database;
+        QString connectionName = QString("library_read_%1").arg(m_nextIndex.fetchAndAddRelaxed(1));
+        if (!database->connectToDatabase(m_path, connectionName, m_options)) {
+            qDebug() << "Read pool: connection" << connectionName << "failed";
+        }
+        m_connections.setLocalData(database);
+    }
+    return m_connections.localData();
+}
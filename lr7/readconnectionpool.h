@@ -0,0 +1,33 @@
+#ifndef READCONNECTIONPOOL_H
+#define READCONNECTIONPOOL_H
+
+#include <QThreadPool>
+#include <QThreadStorage>
+#include <QAtomicInt>
+#include <functional>
+#include "database.h"
+
+// Пул соединений только для чтения: у каждого потока пула своё именованное соединение
+// (library_read_N), поэтому поиски и экспорт выполняются параллельно и в режиме WAL
+// не мешают единственному пишущему соединению
+class ReadConnectionPool
+{
+public:
+    ReadConnectionPool(const QString &path, int size, const DatabaseOptions &options = DatabaseOptions());
+    ~ReadConnectionPool();
+
+    // Выполняет job в одном из потоков пула с соединением этого потока
+    void run(std::function<void(Database *)> job);
+    int size() const;
+
+private:
+    Database *connectionForCurrentThread();
+
+    QString m_path;
+    DatabaseOptions m_options;
+    QThreadStorage<Database *> m_connections;
+    QAtomicInt m_nextIndex;
+    QThreadPool m_threads;
+};
+
+#endif // READCONNECTIONPOOL_H
@@ -0,0 +1,71 @@
+#include "readermodel.h"
+
+ReaderModel::ReaderModel(AsyncDatabase *database, QObject *parent)
+    : KeysetListModel(database, "readerModel", parent)
+{
+}
+
+QVariant ReaderModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= rows().size()) {
+        return QVariant();
+    }
+
+    const Reader &row = rows().at(index.row());
+    switch (role) {
+    case IdRole:
+        return row.id;
+    case Qt::DisplayRole:
+    case NameRole:
+        return row.name;
+    case ContactRole:
+        return row.contact;
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> ReaderModel::roleNames() const
+{
+    return {
+        { IdRole, "id" },
+        { NameRole, "name" },
+        { ContactRole, "contact" }
+    };
+}
+
+ReaderModel::Query ReaderModel::pageQuery(const QString &afterName, int afterId, bool withCount) const
+{
+    return [afterName, afterId, withCount](Database *db) {
+        Page page;
+        if (withCount) {
+            page.totalCount = db->countReaders();
+        }
+        QSqlQuery query = db->queryReadersPage(afterName, afterId, Database::DefaultPageSize);
+        page.rows = Database::readReaders(query);
+        return page;
+    };
+}
+
+ReaderModel::Query ReaderModel::refreshQuery(const QVector<int> &ids, bool withCount) const
+{
+    // Фильтра у списка нет: totalCount меняется только при добавлении и удалении,
+    // и пересчёт не нужен — countedBefore всегда известен
+    Q_UNUSED(withCount)
+    return [ids](Database *db) {
+        Page refresh;
+        QSqlQuery query = db->queryReadersById(ids);
+        refresh.rows = Database::readReaders(query);
+        return refresh;
+    };
+}
+
+void ReaderModel::onReaderInserted(int readerId)
+{
+    markChanged(readerId, 0);
+}
+
+void ReaderModel::onReaderChanged(int readerId)
+{
+    markChanged(readerId, 1);
+}
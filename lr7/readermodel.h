@@ -0,0 +1,31 @@
+#ifndef READERMODEL_H
+#define READERMODEL_H
+
+#include "keysetmodel.h"
+
+// Модель списка читателей для ListView
+class ReaderModel : public KeysetListModel<Reader, &Reader::name>
+{
+    Q_OBJECT
+public:
+    enum Roles {
+        IdRole = Qt::UserRole + 1,
+        NameRole,
+        ContactRole
+    };
+
+    explicit ReaderModel(AsyncDatabase *database, QObject *parent = nullptr);
+
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    // Точечное обновление после изменения читателя в базе (подключаются к сигналам Database)
+    void onReaderInserted(int readerId);
+    void onReaderChanged(int readerId);
+
+private:
+    Query pageQuery(const QString &afterName, int afterId, bool withCount) const override;
+    Query refreshQuery(const QVector<int> &ids, bool withCount) const override;
+};
+
+#endif // READERMODEL_H
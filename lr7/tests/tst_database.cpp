@@ -0,0 +1,567 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <algorithm>
+#include <memory>
+#include <ctime>
+#include "database.h"
+
+// Database без QML: каждая проверка работает со своим файлом во временном каталоге
+class TestDatabase : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void init();
+    void cleanup();
+
+    void keysetPagingAcrossPages();
+    void keysetPagingWithFilter();
+    void fullTextFilterPagesAndCounts();
+    void migrationChainFromLegacySchema();
+    void csvRoundTripKeepsQuotedFields();
+    void issueAndReturnAreAtomic();
+    void bookWithoutLoanIsAvailable();
+    void cacheInvalidatedByWritesFromAnyConnection();
+    void facetSummaryFollowsBookChanges();
+    void loansPerDayFollowsLocalDates();
+    void backupAndRestore();
+    void cancelledBackupKeepsPreviousCopy();
+
+private:
+    QString path(const QString &name) const;
+    // Отдельное соединение для того, что нельзя сделать через Database: старая схема, NULL в столбцах
+    static bool execRaw(const QString &databasePath, const QStringList &statements);
+    static int scalarRaw(const QString &databasePath, const QString &sql);
+    // Таблицы базы версии 0, до первой миграции
+    static QStringList legacySchema();
+    // Все книги, прочитанные страницами по pageSize строк
+    static QVector<Book> readAllPages(Database &db, const BookFilter &filter, int pageSize);
+    // Число книг со значением value в срезе facet из результата facetCounts, 0 — значения нет
+    static int facetCount(const QVariantMap &facets, const QString &facet, const QVariant &value);
+
+    std::unique_ptr<QTemporaryDir> m_dir;
+};
+
+void TestDatabase::initTestCase()
+{
+#ifdef Q_OS_UNIX
+    // Пояс со смещением и переходом на летнее время (правило POSIX, без базы tzdata):
+    // в UTC ошибки в пересчёте местного времени не были бы видны
+    qputenv("TZ", "CET-1CEST,M3.5.0,M10.5.0/3");
+    tzset();
+#endif
+}
+
+void TestDatabase::init()
+{
+    m_dir.reset(new QTemporaryDir());
+    QVERIFY(m_dir->isValid());
+}
+
+void TestDatabase::cleanup()
+{
+    m_dir.reset();
+}
+
+QString TestDatabase::path(const QString &name) const
+{
+    return m_dir->filePath(name);
+}
+
+bool TestDatabase::execRaw(const QString &databasePath, const QStringList &statements)
+{
+    bool ok = true;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "tst_raw");
+        db.setDatabaseName(databasePath);
+        ok = db.open();
+        QSqlQuery query(db);
+        for (const QString &statement : statements) {
+            if (ok && !query.exec(statement)) {
+                qWarning() << statement << query.lastError().text();
+                ok = false;
+            }
+        }
+        db.close();
+    }
+    QSqlDatabase::removeDatabase("tst_raw");
+    return ok;
+}
+
+int TestDatabase::scalarRaw(const QString &databasePath, const QString &sql)
+{
+    int value = -1;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "tst_raw");
+        db.setDatabaseName(databasePath);
+        if (db.open()) {
+            QSqlQuery query(db);
+            if (query.exec(sql) && query.next()) {
+                value = query.value(0).toInt();
+            }
+        }
+        db.close();
+    }
+    QSqlDatabase::removeDatabase("tst_raw");
+    return value;
+}
+
+QStringList TestDatabase::legacySchema()
+{
+    return {
+        "CREATE TABLE books (id INTEGER PRIMARY KEY AUTOINCREMENT, title TEXT, author TEXT, "
+        "year INTEGER, genre TEXT, available BOOLEAN)",
+        "CREATE TABLE readers (id INTEGER PRIMARY KEY AUTOINCREMENT, name TEXT, contact TEXT)",
+        "CREATE TABLE loans (id INTEGER PRIMARY KEY AUTOINCREMENT, book_id INTEGER, reader_id INTEGER, issue_date TEXT)"
+    };
+}
+
+QVector<Book> TestDatabase::readAllPages(Database &db, const BookFilter &filter, int pageSize)
+{
+    QVector<Book> books;
+    QString afterTitle;
+    int afterId = 0;
+    while (true) {
+        QSqlQuery query = db.queryBooksPage(filter, afterTitle, afterId, pageSize);
+        const QVector<Book> page = Database::readBooks(query);
+        books += page;
+        if (page.size() < pageSize) {
+            return books;
+        }
+        afterTitle = page.last().title;
+        afterId = page.last().id;
+    }
+}
+
+int TestDatabase::facetCount(const QVariantMap &facets, const QString &facet, const QVariant &value)
+{
+    const QVariantList values = facets.value(facet).toList();
+    for (const QVariant &entry : values) {
+        const QVariantMap map = entry.toMap();
+        if (map.value("value") == value) {
+            return map.value("count").toInt();
+        }
+    }
+    return 0;
+}
+
+void TestDatabase::keysetPagingAcrossPages()
+{
+    Database db;
+    QVERIFY(db.connectToDatabase(path("paging.db"), "tst_paging"));
+
+    // Повторяющиеся названия и NULL на границах страниц: ключ (COALESCE(title, ''), id)
+    const QStringList titles = { "Бесы", "Анна Каренина", "Бесы", "Идиот", "Anna", "Бесы", "Ёлка", "Zoo" };
+    const int bookCount = 53;
+    for (int i = 0; i < bookCount; i++) {
+        QVERIFY(db.addBook(titles.at(i % titles.size()), QString("Автор %1").arg(i % 4), 1900 + i, "Роман"));
+    }
+    QVERIFY(execRaw(path("paging.db"), { "UPDATE books SET title = NULL WHERE id % 9 = 0",
+                                         "UPDATE books SET title = '' WHERE id = 10" }));
+
+    // Ожидаемый порядок строится по тем же правилам, что и ORDER BY в запросе
+    QVector<QPair<QString, int>> expected;
+    for (int id = 1; id <= bookCount; id++) {
+        QString title = id % 9 == 0 || id == 10 ? QString() : titles.at((id - 1) % titles.size());
+        expected.append(qMakePair(title, id));
+    }
+    std::sort(expected.begin(), expected.end(), [](const QPair<QString, int> &a, const QPair<QString, int> &b) {
+        int order = QString::compare(a.first, b.first);
+        return order < 0 || (order == 0 && a.second < b.second);
+    });
+
+    for (int pageSize : { 1, 7, 9, 50, bookCount }) {
+        const QVector<Book> books = readAllPages(db, BookFilter(), pageSize);
+        QCOMPARE(books.size(), bookCount);
+        for (int i = 0; i < bookCount; i++) {
+            QCOMPARE(books.at(i).id, expected.at(i).second);
+        }
+    }
+    QCOMPARE(db.countBooksMatching(BookFilter()), bookCount);
+}
+
+void TestDatabase::keysetPagingWithFilter()
+{
+    Database db;
+    QVERIFY(db.connectToDatabase(path("filter.db"), "tst_filter"));
+    for (int i = 0; i < 40; i++) {
+        QVERIFY(db.addBook(QString("Том %1").arg(i % 5), i % 2 ? "Толстой" : "Достоевский", 1850 + i, "Роман"));
+    }
+
+    BookFilter filter;
+    filter.author = "Толстой";
+    const QVector<Book> books = readAllPages(db, filter, 6);
+    QCOMPARE(books.size(), 20);
+    QCOMPARE(db.countBooksMatching(filter), 20);
+    for (int i = 0; i < books.size(); i++) {
+        QCOMPARE(books.at(i).author, QString("Толстой"));
+        if (i > 0) {
+            QVERIFY(books.at(i - 1).title < books.at(i).title
+                    || (books.at(i - 1).title == books.at(i).title && books.at(i - 1).id < books.at(i).id));
+        }
+    }
+}
+
+void TestDatabase::fullTextFilterPagesAndCounts()
+{
+    Database db;
+    QVERIFY(db.connectToDatabase(path("fts.db"), "tst_fts"));
+    for (int i = 0; i < 30; i++) {
+        QVERIFY(db.addBook(QString("Книга %1").arg(i), i % 3 ? "Пушкин" : "Гоголь", 1830 + i, "Проза"));
+    }
+
+    // Тот же отбор, что и у поиска подстроки, но через индекс; страницы идут в порядке (title, id)
+    BookFilter filter;
+    filter.searchTerm = "Гоголь";
+    filter.fullText = true;
+    QCOMPARE(db.countBooksMatching(filter), 10);
+    const QVector<Book> books = readAllPages(db, filter, 3);
+    QCOMPARE(books.size(), 10);
+    for (const Book &book : books) {
+        QCOMPARE(book.author, QString("Гоголь"));
+    }
+    QCOMPARE(db.facetCountsMatching(filter, 0).value("total").toInt(), 10);
+
+    // Изменение автора доходит до индекса через триггер, а кэш подсчёта сбрасывается
+    QVERIFY(db.updateBook(books.first().id, books.first().title, "Пушкин", books.first().year, "Проза"));
+    QCOMPARE(db.countBooksMatching(filter), 9);
+
+    // Строка без слов не даёт выражения MATCH и ищется подстрокой
+    filter.searchTerm = "!!";
+    QCOMPARE(db.countBooksMatching(filter), 0);
+}
+
+void TestDatabase::migrationChainFromLegacySchema()
+{
+    // База версии 0: исходные таблицы без индексов, текстовая дата выдачи и две выдачи одной книги
+    const QString legacy = path("legacy.db");
+    QVERIFY(execRaw(legacy, legacySchema() + QStringList {
+        "INSERT INTO books (title, author, year, genre, available) VALUES ('Бесы', 'Достоевский', 1872, 'Роман', 1)",
+        "INSERT INTO books (title, author, year, genre, available) VALUES (NULL, 'Толстой', 1869, 'Роман', 1)",
+        "INSERT INTO readers (name, contact) VALUES ('Иванов', 'ivanov@example.com')",
+        "INSERT INTO loans (book_id, reader_id, issue_date) VALUES (1, 1, '2024-01-01T10:00:00')",
+        "INSERT INTO loans (book_id, reader_id, issue_date) VALUES (1, 1, '2024-01-02T10:00:00')"
+    }));
+
+    {
+        Database db;
+        QVERIFY(db.connectToDatabase(legacy, "tst_legacy"));
+        QCOMPARE(db.countBooksMatching(BookFilter()), 2);
+
+        // Выдача одной книги осталась одна, книга недоступна, срок — DefaultLoanDays от выдачи
+        const QVariantList history = db.readerLoanHistory(1, 10);
+        QCOMPARE(history.size(), 1);
+        const QVariantMap loan = history.first().toMap();
+        // issue_date записана в местном времени без смещения
+        QCOMPARE(loan.value("issued_at").toDateTime(), QDateTime(QDate(2024, 1, 2), QTime(10, 0)));
+        QCOMPARE(loan.value("due_at").toDateTime().toSecsSinceEpoch()
+                     - loan.value("issued_at").toDateTime().toSecsSinceEpoch(),
+                 qint64(Database::DefaultLoanDays) * Database::SecondsPerDay);
+        const QVector<Book> books = readAllPages(db, BookFilter(), 1);
+        QCOMPARE(books.size(), 2);
+        QCOMPARE(books.first().title, QString()); // NULL идёт первым как пустая строка
+        QVERIFY(!books.last().available);
+
+        QVERIFY(db.returnBook(1));
+        QVERIFY(!db.returnBook(1)); // Повторный возврат ничего не меняет
+        db.closeDatabase();
+    }
+
+    QCOMPARE(scalarRaw(legacy, "PRAGMA user_version"), 7);
+    QCOMPARE(scalarRaw(legacy, "SELECT COUNT(*) FROM loans"), 0);
+    QCOMPARE(scalarRaw(legacy, "SELECT COUNT(*) FROM loan_history WHERE returned_at IS NOT NULL"), 1);
+    QCOMPARE(scalarRaw(legacy, "SELECT COUNT(*) FROM sqlite_master WHERE name = 'idx_books_title_key'"), 1);
+    QCOMPARE(scalarRaw(legacy, "SELECT COUNT(*) FROM sqlite_master "
+                               "WHERE name IN ('idx_books_title', 'idx_readers_name')"), 0);
+
+    // Повторное открытие не применяет миграции заново
+    Database reopened;
+    QVERIFY(reopened.connectToDatabase(legacy, "tst_reopened"));
+    QCOMPARE(reopened.countBooksMatching(BookFilter()), 2);
+}
+
+void TestDatabase::csvRoundTripKeepsQuotedFields()
+{
+    // Запятые, кавычки и переводы строк внутри полей (RFC 4180)
+    const QStringList titles = { "Простое", "С запятой, внутри", "С \"кавычками\"", "Две\nстроки", "" };
+    Database source;
+    QVERIFY(source.connectToDatabase(path("source.db"), "tst_csv_source"));
+    for (const QString &title : titles) {
+        QVERIFY(source.addBook(title, "Автор, \"псевдоним\"", 2000, "Жанр"));
+    }
+    QVERIFY(source.exportToCSV(path("books.csv")));
+
+    Database target;
+    QVERIFY(target.connectToDatabase(path("target.db"), "tst_csv_target"));
+    QVERIFY(target.importBooksFromCSV(path("books.csv"), 2));
+    const QVector<Book> imported = readAllPages(target, BookFilter(), 100);
+    QCOMPARE(imported.size(), titles.size());
+
+    QStringList importedTitles;
+    for (const Book &book : imported) {
+        importedTitles.append(book.title);
+        QCOMPARE(book.author, QString("Автор, \"псевдоним\""));
+        QCOMPARE(book.year, 2000);
+        QVERIFY(book.available);
+    }
+    QStringList expectedTitles = titles;
+    expectedTitles.sort();
+    importedTitles.sort();
+    QCOMPARE(importedTitles, expectedTitles);
+}
+
+void TestDatabase::issueAndReturnAreAtomic()
+{
+    Database db;
+    QVERIFY(db.connectToDatabase(path("loans.db"), "tst_loans"));
+    for (int i = 0; i < 3; i++) {
+        QVERIFY(db.addBook(QString("Книга %1").arg(i), "Автор", 1900, "Жанр"));
+    }
+    QVERIFY(db.addReader("Сидоров", "sidorov@example.com"));
+
+    QVERIFY(db.issueBook(1, 1));
+    QVERIFY(!db.issueBook(1, 1)); // Выданную книгу нельзя выдать второй раз
+    QVERIFY(!db.issueBook(2, 99)); // Несуществующему читателю книга не выдаётся
+
+    // Одна занятая книга в стопке отменяет выдачу всей стопки
+    QVERIFY(!db.issueBooks(1, { 2, 1, 3 }));
+    QCOMPARE(scalarRaw(path("loans.db"), "SELECT COUNT(*) FROM loans"), 1);
+    QCOMPARE(scalarRaw(path("loans.db"), "SELECT COUNT(*) FROM books WHERE available = 1"), 2);
+
+    QVERIFY(db.returnBook(1));
+    QVERIFY(!db.returnBook(1)); // Повторный возврат ничего не меняет
+    QVERIFY(!db.returnBook(2)); // Невыданную книгу вернуть нельзя
+
+    QVERIFY(db.issueBooks(1, { 1, 2, 3 }));
+    QCOMPARE(scalarRaw(path("loans.db"), "SELECT COUNT(*) FROM loans"), 3);
+    QCOMPARE(scalarRaw(path("loans.db"), "SELECT COUNT(*) FROM books WHERE available = 1"), 0);
+}
+
+void TestDatabase::bookWithoutLoanIsAvailable()
+{
+    // Старая база, где книга без выдачи отмечена недоступной, а выданная — доступной:
+    // ни выдача, ни возврат не могли бы изменить состояние таких книг
+    const QString legacy = path("stuck.db");
+    QVERIFY(execRaw(legacy, legacySchema() + QStringList {
+        "INSERT INTO books (title, author, year, genre, available) VALUES ('Без выдачи', 'Автор', 1900, 'Жанр', 0)",
+        "INSERT INTO books (title, author, year, genre, available) VALUES ('Выдана', 'Автор', 1900, 'Жанр', 1)",
+        "INSERT INTO readers (name, contact) VALUES ('Иванов', 'ivanov@example.com')",
+        "INSERT INTO loans (book_id, reader_id, issue_date) VALUES (2, 1, '2024-01-01T10:00:00')"
+    }));
+
+    Database db;
+    QVERIFY(db.connectToDatabase(legacy, "tst_stuck"));
+    QCOMPARE(scalarRaw(legacy, "SELECT available FROM books WHERE id = 1"), 1);
+    QCOMPARE(scalarRaw(legacy, "SELECT available FROM books WHERE id = 2"), 0);
+    QVERIFY(db.issueBook(1, 1));
+    QVERIFY(db.returnBook(1));
+    QVERIFY(db.returnBook(2));
+    QVERIFY(db.issueBook(2, 1));
+
+    // Значение available из CSV не переносится: у импортированной книги нет выдачи
+    QFile file(path("unavailable.csv"));
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Text));
+    file.write("title,author,year,genre,available\nИз файла,Автор,1900,Жанр,No\n");
+    file.close();
+    QVERIFY(db.importBooksFromCSV(path("unavailable.csv"), 10));
+    QCOMPARE(scalarRaw(legacy, "SELECT available FROM books WHERE id = 3"), 1);
+    QVERIFY(db.issueBook(3, 1));
+    QVERIFY(db.returnBook(3));
+}
+
+void TestDatabase::cacheInvalidatedByWritesFromAnyConnection()
+{
+    // Пишущее и читающее соединения с одним файлом делят один кэш
+    Database writer;
+    QVERIFY(writer.connectToDatabase(path("cache.db"), "tst_cache_writer"));
+    Database reader;
+    QVERIFY(reader.connectToDatabase(path("cache.db"), "tst_cache_reader"));
+    for (int i = 0; i < 5; i++) {
+        QVERIFY(writer.addBook(QString("Книга %1").arg(i), "Пушкин", 1830 + i, "Проза"));
+    }
+    QVERIFY(writer.addReader("Петров", "petrov@example.com"));
+
+    QCOMPARE(reader.searchBooks("Пушкин").size(), 5);
+    const quint64 hits = reader.cacheStats().value("hits").toULongLong();
+    QCOMPARE(reader.searchBooks("Пушкин").size(), 5);
+    QCOMPARE(reader.cacheStats().value("hits").toULongLong(), hits + 1);
+
+    // Запись через другое соединение не оставляет устаревших результатов
+    const quint64 generation = reader.cacheStats().value("generation").toULongLong();
+    QVERIFY(writer.addBook("Книга 5", "Пушкин", 1835, "Проза"));
+    QVERIFY(reader.cacheStats().value("generation").toULongLong() > generation);
+    QCOMPARE(reader.searchBooks("Пушкин").size(), 6);
+
+    BookFilter available;
+    available.onlyAvailable = true;
+    QCOMPARE(reader.countBooksMatching(available), 6);
+    QVERIFY(writer.issueBook(1, 1));
+    QCOMPARE(reader.countBooksMatching(available), 5);
+    QVERIFY(writer.returnBook(1));
+    QCOMPARE(reader.countBooksMatching(available), 6);
+    QVERIFY(writer.deleteBook(2));
+    QCOMPARE(reader.countBooksMatching(available), 5);
+}
+
+void TestDatabase::facetSummaryFollowsBookChanges()
+{
+    Database db;
+    QVERIFY(db.connectToDatabase(path("facets.db"), "tst_facets"));
+    for (int i = 0; i < 12; i++) {
+        QVERIFY(db.addBook(QString("Книга %1").arg(i), i % 2 ? "Чехов" : "Бунин", 1890 + i, i % 3 ? "Рассказ" : "Повесть"));
+    }
+    QVERIFY(db.addReader("Петров", "petrov@example.com"));
+
+    // Фильтр, который пропускает все книги, считает срезы группировкой по books, а пустой
+    // фильтр читает поддерживаемую триггерами сводную таблицу: результаты должны совпасть
+    BookFilter everything;
+    everything.minYear = 1;
+    auto checkSummary = [&]() {
+        QCOMPARE(db.facetCountsMatching(BookFilter(), 0), db.facetCountsMatching(everything, 0));
+    };
+
+    QVariantMap facets = db.facetCountsMatching(BookFilter(), 0);
+    QCOMPARE(facets.value("total").toInt(), 12);
+    QCOMPARE(facetCount(facets, "genre", "Повесть"), 4);
+    QCOMPARE(facetCount(facets, "decade", 1890), 10);
+    QCOMPARE(facetCount(facets, "decade", 1900), 2);
+    checkSummary();
+
+    // Выдача меняет только срез available
+    QVERIFY(db.issueBooks(1, { 1, 2, 3 }));
+    facets = db.facetCountsMatching(BookFilter(), 0);
+    QCOMPARE(facetCount(facets, "available", 0), 3);
+    QCOMPARE(facetCount(facets, "available", 1), 9);
+    checkSummary();
+
+    // Изменение жанра переносит книгу между значениями, опустевшее значение исчезает
+    for (int id : { 1, 4, 7, 10 }) {
+        QVERIFY(db.updateBook(id, QString("Книга %1").arg(id - 1), id % 2 ? "Бунин" : "Чехов", 1889 + id, "Роман"));
+    }
+    facets = db.facetCountsMatching(BookFilter(), 0);
+    QCOMPARE(facetCount(facets, "genre", "Повесть"), 0);
+    QCOMPARE(facetCount(facets, "genre", "Роман"), 4);
+    QCOMPARE(facets.value("genre").toList().size(), 2);
+    checkSummary();
+
+    QVERIFY(db.returnBook(1));
+    QVERIFY(db.deleteBook(1));
+    QVERIFY(db.deleteBook(12));
+    facets = db.facetCountsMatching(BookFilter(), 0);
+    QCOMPARE(facets.value("total").toInt(), 10);
+    QCOMPARE(facetCount(facets, "decade", 1900), 1);
+    QCOMPARE(facetCount(facets, "available", 0), 2);
+    checkSummary();
+}
+
+void TestDatabase::loansPerDayFollowsLocalDates()
+{
+    Database db;
+    QVERIFY(db.connectToDatabase(path("days.db"), "tst_days"));
+
+    // Выдачи около полуночи по обе стороны перехода на летнее время 31 марта 2024 года
+    const QVector<QDateTime> issued = {
+        QDateTime(QDate(2024, 3, 30), QTime(23, 30)),
+        QDateTime(QDate(2024, 3, 31), QTime(0, 30)),
+        QDateTime(QDate(2024, 3, 31), QTime(23, 30)),
+        QDateTime(QDate(2024, 4, 1), QTime(0, 30))
+    };
+    QStringList statements;
+    for (const QDateTime &issuedAt : issued) {
+        statements.append(QString("INSERT INTO loan_history (book_id, reader_id, issued_at, due_at) VALUES (1, 1, %1, %2)")
+                              .arg(issuedAt.toSecsSinceEpoch())
+                              .arg(issuedAt.toSecsSinceEpoch() + Database::SecondsPerDay));
+    }
+    QVERIFY(execRaw(path("days.db"), statements));
+
+    const QVariantList days = db.loansPerDay(QDateTime(QDate(2024, 3, 30), QTime(0, 0)),
+                                             QDateTime(QDate(2024, 4, 2), QTime(0, 0)));
+    QCOMPARE(days.size(), 3);
+    QCOMPARE(days.at(0).toMap().value("date").toDate(), QDate(2024, 3, 30));
+    QCOMPARE(days.at(0).toMap().value("count").toInt(), 1);
+    QCOMPARE(days.at(1).toMap().value("date").toDate(), QDate(2024, 3, 31));
+    QCOMPARE(days.at(1).toMap().value("count").toInt(), 2);
+    QCOMPARE(days.at(2).toMap().value("date").toDate(), QDate(2024, 4, 1));
+    QCOMPARE(days.at(2).toMap().value("count").toInt(), 1);
+}
+
+void TestDatabase::backupAndRestore()
+{
+    Database db;
+    QVERIFY(db.connectToDatabase(path("live.db"), "tst_backup"));
+    for (int i = 0; i < 30; i++) {
+        QVERIFY(db.addBook(QString("Книга %1").arg(i), i % 3 ? "Пушкин" : "Гоголь", 1830 + i, "Проза"));
+    }
+    QVERIFY(db.addReader("Петров", "petrov@example.com"));
+    QVERIFY(db.issueBook(1, 1));
+    // Счётчик AUTOINCREMENT в снимке больше наибольшего id
+    QVERIFY(db.addBook("Удалённая", "Автор", 1900, "Проза"));
+    QVERIFY(db.deleteBook(31));
+
+    // Шаг меньше таблицы: копирование идёт несколькими порциями с прогрессом
+    int steps = 0;
+    int lastCopied = -1;
+    int lastTotal = -1;
+    auto progress = [&](int copied, int total) {
+        QVERIFY(copied >= lastCopied);
+        steps++;
+        lastCopied = copied;
+        lastTotal = total;
+    };
+    QVERIFY(db.backupTo(path("snapshot.db"), progress, std::function<bool()>(), 4));
+    QVERIFY(steps > 1);
+    QCOMPARE(lastCopied, lastTotal);
+    QVERIFY(!QFile::exists(path("snapshot.db.part")));
+
+    // Изменения после снимка отменяются восстановлением
+    for (int id = 2; id <= 11; id++) {
+        QVERIFY(db.deleteBook(id));
+    }
+    QVERIFY(db.returnBook(1));
+    QCOMPARE(db.countBooksMatching(BookFilter()), 20);
+
+    QSignalSpy restored(&db, &Database::databaseRestored);
+    QVERIFY(db.restoreFrom(path("snapshot.db"), std::function<void(int, int)>(), std::function<bool()>(), 7));
+    QCOMPARE(restored.count(), 1);
+    QCOMPARE(db.countBooksMatching(BookFilter()), 30);
+    QCOMPARE(db.searchBooksRanked("Гоголь", 100).size(), 10);
+    QCOMPARE(db.overdueLoans().size(), 0);
+    QVERIFY(db.returnBook(1)); // Выдача из снимка восстановлена
+
+    // Счётчик AUTOINCREMENT восстановлен: новый id не повторяет удалённый до снимка
+    QVERIFY(db.addBook("Новая", "Лермонтов", 1840, "Проза"));
+    const QVector<Book> books = readAllPages(db, BookFilter(), 100);
+    int maxId = 0;
+    for (const Book &book : books) {
+        maxId = qMax(maxId, book.id);
+    }
+    QCOMPARE(maxId, 32);
+}
+
+void TestDatabase::cancelledBackupKeepsPreviousCopy()
+{
+    Database db;
+    QVERIFY(db.connectToDatabase(path("cancel.db"), "tst_cancel"));
+    for (int i = 0; i < 20; i++) {
+        QVERIFY(db.addBook(QString("Книга %1").arg(i), "Автор", 1900, "Жанр"));
+    }
+    QVERIFY(db.backupTo(path("copy.db")));
+    QVERIFY(db.addBook("Ещё одна", "Автор", 1900, "Жанр"));
+
+    // Отмена после первой порции: прежняя копия остаётся на месте без изменений
+    QVERIFY(!db.backupTo(path("copy.db"), std::function<void(int, int)>(), []() { return true; }, 4));
+    QVERIFY(!QFile::exists(path("copy.db.part")));
+    QCOMPARE(scalarRaw(path("copy.db"), "SELECT COUNT(*) FROM books"), 20);
+
+    QVERIFY(db.backupTo(path("copy.db")));
+    QVERIFY(!QFile::exists(path("copy.db.old")));
+    QCOMPARE(scalarRaw(path("copy.db"), "SELECT COUNT(*) FROM books"), 21);
+}
+
+QTEST_GUILESS_MAIN(TestDatabase)
+
+#include "tst_database.moc"
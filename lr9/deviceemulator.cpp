@@ -1,12 +1,61 @@
 #include "deviceemulator.h"
-#include <QMessageBox>
 #include <QDebug>
 #include <QFile>
 #include <QFileInfo>
+#include <QRandomGenerator>
+#include <QTimer>
+#include <QtConcurrent>
+
+namespace {
+
+// Метки назначения выработанных ключей
+const uint8_t EncryptionKeyLabel = 0x01;
+const uint8_t MacKeyLabel = 0x02;
+const uint8_t ManifestKeyLabel = 0x03;
+
+void putBigEndian(uint8_t *p, quint64 value, int size)
+{
+    for (int i = 0; i < size; i++) {
+        p[i] = uint8_t(value >> (8 * (size - 1 - i)));
+    }
+}
+
+// Сравнение за время, не зависящее от позиции первого расхождения
+bool tagsEqual(const uint8_t *a, const uint8_t *b)
+{
+    uint8_t diff = 0;
+    for (size_t i = 0; i < MagmaCmac::TagSize; i++) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+// Число кусков файла; пустой файл — один пустой кусок
+quint64 chunkCountFor(qint64 fileSize, qint64 chunkSize)
+{
+    return fileSize == 0 ? 1 : quint64((fileSize + chunkSize - 1) / chunkSize);
+}
+
+qint64 chunkLengthFor(qint64 fileSize, qint64 chunkSize, quint64 index)
+{
+    return qMin(chunkSize, fileSize - qint64(index) * chunkSize);
+}
+
+// Доля переданного в процентах; пустой файл сразу передан целиком
+int percentOf(qint64 done, qint64 total)
+{
+    return total > 0 ? int(done * 100 / total) : 100;
+}
+
+} // namespace
 
 DeviceEmulator::DeviceEmulator(const QString &userType, QObject *parent)
-    : QObject(parent), userType(userType), server(new QTcpServer(this)), socket(nullptr),
-      state(WaitingForHeader), fileStream(nullptr), original_size(0), encrypted_size(0), remainingBytes(0)
+    : QObject(parent), userType(userType), server(new QTcpServer(this)), socket(nullptr), established(false),
+      sendStream(nullptr), sendChunkSize(ChunkSize), sendIv(0), sendSize(0), sendChunkCount(0), waitingForRanges(false),
+      sendBytesTotal(0), sendBytesDone(0), sendPercent(-1),
+      receiveIv(0), chunkSize(0), chunkCount(0), currentChunk(0), missingCount(0),
+      receivedBytes(0), neededBytes(0), receivePercent(-1), bufferOffset(0),
+      state(WaitingForHeader), fileStream(nullptr), original_size(0)
 {
     uuidToPortMap[QUuid("550e8400-e29b-41d4-a716-446655440000")] = 12345;
     uuidToPortMap[QUuid("550e8400-e29b-41d4-a716-446655440001")] = 12346;
@@ -15,60 +64,130 @@ DeviceEmulator::DeviceEmulator(const QString &userType, QObject *parent)
         ? QUuid("550e8400-e29b-41d4-a716-446655440000")
         : QUuid("550e8400-e29b-41d4-a716-446655440001");
 
-    if (!server->listen(QHostAddress::LocalHost, uuidToPortMap[localUuid])) {
-        qCritical() << "Не удалось запустить сервер:" << server->errorString();
-    } else {
-        qDebug() << "Сервер запущен на порту" << uuidToPortMap[ localUuid];
-    }
-
     connect(server, &QTcpServer::newConnection, this, &DeviceEmulator::onNewConnection);
 
-    // Установка ключа шифрования
+    // Общий ключ; из него выработаны отдельные ключи шифрования, имитовставки и манифеста.
+    // Гамма каждого файла задаётся своим IV из заголовка
     QByteArray key = QByteArray::fromHex("00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff");
-    magma.setKey(key);
+    encryptionKey = deriveKey(key, EncryptionKeyLabel);
+    macKey = deriveKey(key, MacKeyLabel);
+    receiveMac.setKey(macKey);
+    sendMac.setKey(macKey);
+    manifestMac.setKey(deriveKey(key, ManifestKeyLabel));
+}
+
+QByteArray DeviceEmulator::deriveKey(const QByteArray &key, uint8_t label)
+{
+    // Ключ — зашифрованные общим ключом блоки (label, 0, ..., номер блока)
+    Magma cipher;
+    cipher.setKey(key);
+    uint8_t blocks[32] = {};
+    for (int i = 0; i < 4; i++) {
+        blocks[i * 8] = label;
+        blocks[i * 8 + 7] = uint8_t(i);
+    }
+    cipher.encryptBlocks(blocks, blocks, 4);
+    return QByteArray(reinterpret_cast<const char *>(blocks), sizeof(blocks));
+}
+
+void DeviceEmulator::chunkTag(MagmaCmac &mac, quint32 iv, qint64 fileSize, quint64 index, bool last,
+                              const uint8_t *data, size_t size, uint8_t *tag)
+{
+    uint8_t prefix[21];
+    putBigEndian(prefix, iv, 4);
+    putBigEndian(prefix + 4, quint64(fileSize), 8);
+    putBigEndian(prefix + 12, index, 8);
+    prefix[20] = last ? 1 : 0;
+
+    mac.reset();
+    mac.update(prefix, sizeof(prefix));
+    mac.update(data, size);
+    mac.final(tag);
+}
+
+void DeviceEmulator::chunkHash(MagmaCmac &mac, quint64 index, const uint8_t *data, size_t size, uint8_t *hash)
+{
+    uint8_t prefix[8];
+    putBigEndian(prefix, index, 8);
+
+    mac.reset();
+    mac.update(prefix, sizeof(prefix));
+    mac.update(data, size);
+    mac.final(hash);
 }
 
 DeviceEmulator::~DeviceEmulator()
 {
+    abortSending();
     disconnect();
     server->close();
 }
 
-bool DeviceEmulator::connectToDevice(const QString &uuid)
+void DeviceEmulator::start()
+{
+    // Сервер запускается уже в рабочем потоке, чтобы его сокет принадлежал этому потоку
+    if (!server->listen(QHostAddress::LocalHost, uuidToPortMap[localUuid])) {
+        qCritical() << "Не удалось запустить сервер:" << server->errorString();
+    } else {
+        qDebug() << "Сервер запущен на порту" << uuidToPortMap[ localUuid];
+    }
+}
+
+void DeviceEmulator::connectToDevice(const QString &uuid)
 {
     QUuid targetUuid(uuid);
     if (!uuidToPortMap.contains(targetUuid) || targetUuid == localUuid) {
-        return false;
+        emit connectionFailed("Неизвестное устройство");
+        return;
     }
 
-    if (socket) {
-        socket->disconnectFromHost();
-        socket->deleteLater();
-    }
+    releaseSocket();
 
     socket = new QTcpSocket(this);
     connect(socket, &QTcpSocket::readyRead, this, &DeviceEmulator::onReadyRead);
+    connect(socket, &QTcpSocket::bytesWritten, this, &DeviceEmulator::onBytesWritten);
     connect(socket, &QTcpSocket::disconnected, this, &DeviceEmulator::onDisconnected);
     connect(socket, &QTcpSocket::errorOccurred, this, &DeviceEmulator::onSocketError);
+    connect(socket, &QTcpSocket::connected, this, &DeviceEmulator::onConnected);
 
+    // Подключение не блокирует поток: результат придёт в onConnected или onSocketError
+    connectingUuid = targetUuid;
     socket->connectToHost(QHostAddress::LocalHost, uuidToPortMap[targetUuid]);
 
-    if (!socket->waitForConnected(3000)) {
-        qWarning() << "Не удалось подключиться:" << socket->errorString();
-        return false;
-    }
+    QTcpSocket *attempt = socket;
+    QTimer::singleShot(ConnectTimeout, this, [this, attempt]() {
+        if (socket == attempt && !connectingUuid.isNull()) {
+            qWarning() << "Не удалось подключиться: тайм-аут";
+            // Попытка обрывается, пока она ещё считается подключением, и её сигналы
+            // отключаются: запоздалая ошибка не превратится в connectionLost
+            socket->disconnect(this);
+            socket->abort();
+            socket->deleteLater();
+            socket = nullptr;
+            connectingUuid = QUuid();
+            emit connectionFailed("Тайм-аут подключения");
+        }
+    });
+}
 
-    remoteUuid = targetUuid;
+void DeviceEmulator::onConnected()
+{
+    remoteUuid = connectingUuid;
+    connectingUuid = QUuid();
+    established = true;
     emit connectionEstablished();
-    return true;
+
+    // Досылаем файлы, прерванные прошлым обрывом
+    if (!sendStream) {
+        startNextFile();
+    }
 }
 
 void DeviceEmulator::sendData(const QString &data)
 {
     if (socket && socket->state() == QAbstractSocket::ConnectedState) {
-        QString message = "TEXT:" + data + "\n";
-        socket->write(message.toUtf8());
-        socket->flush();
+        // Куски файла идут целыми кадрами CHUNK, поэтому сообщение можно вставить между ними
+        socket->write(("TEXT:" + data + "\n").toUtf8());
     }
 }
 
@@ -79,74 +198,299 @@ void DeviceEmulator::sendFile(const QString &filePath)
         return;
     }
 
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly)) {
-        qWarning() << "Cannot open file for reading:" << filePath;
+    pendingFiles.append(filePath);
+    if (!sendStream) {
+        startNextFile();
+    }
+}
+
+void DeviceEmulator::startHashing(ChunkHashing &hashing, QFile *file, qint64 fileSize, qint64 chunkSize,
+                                  void (DeviceEmulator::*done)(bool))
+{
+    // Хэшируются только куски, целиком лежащие в файле; хэши остальных остаются нулевыми
+    quint64 count = chunkCountFor(fileSize, chunkSize);
+    qint64 available = qMin(file->size(), fileSize);
+    hashing.file = file;
+    hashing.fileSize = fileSize;
+    hashing.chunkSize = chunkSize;
+    hashing.next = 0;
+    hashing.complete = available == fileSize ? count : quint64(available / chunkSize);
+    hashing.hashes.fill(0, qsizetype(count * MagmaCmac::TagSize));
+    hashing.active = true;
+    hashing.generation++;
+    scheduleHashBatch(hashing, done);
+}
+
+void DeviceEmulator::scheduleHashBatch(ChunkHashing &hashing, void (DeviceEmulator::*done)(bool))
+{
+    ChunkHashing *target = &hashing;
+    int generation = hashing.generation;
+    QTimer::singleShot(0, this, [this, target, generation, done]() {
+        if (!target->active || target->generation != generation) {
+            return; // Подсчёт отменён: файл закрыт или соединение потеряно
+        }
+        bool ok = hashBatch(*target);
+        if (ok && target->next < target->complete) {
+            scheduleHashBatch(*target, done);
+            return;
+        }
+        target->active = false;
+        (this->*done)(ok);
+    });
+}
+
+bool DeviceEmulator::hashBatch(ChunkHashing &hashing)
+{
+    // Пачка читается одним вызовом, её куски хэшируются параллельно в глобальном пуле
+    const qint64 chunkSize = hashing.chunkSize;
+    const qint64 fileSize = hashing.fileSize;
+    quint64 first = hashing.next;
+    quint64 last = qMin(hashing.complete, first + quint64(qMax<qint64>(1, ManifestBatchBytes / chunkSize)));
+    if (first >= last) {
+        return true;
+    }
+    qint64 begin = qint64(first) * chunkSize;
+    qint64 end = qMin(qint64(last) * chunkSize, fileSize);
+    QByteArray data(end - begin, Qt::Uninitialized);
+    if (!hashing.file->seek(begin) || hashing.file->read(data.data(), end - begin) != end - begin) {
+        return false;
+    }
+
+    std::vector<quint64> indices;
+    indices.reserve(last - first);
+    for (quint64 i = first; i < last; i++) {
+        indices.push_back(i);
+    }
+    const uint8_t *base = reinterpret_cast<const uint8_t *>(data.constData());
+    uint8_t *out = reinterpret_cast<uint8_t *>(hashing.hashes.data());
+    QtConcurrent::blockingMap(indices, [&](quint64 i) {
+        MagmaCmac mac = manifestMac;
+        chunkHash(mac, i, base + (qint64(i) * chunkSize - begin),
+                  size_t(chunkLengthFor(fileSize, chunkSize, i)), out + i * MagmaCmac::TagSize);
+    });
+    hashing.next = last;
+    return true;
+}
+
+void DeviceEmulator::cancelHashing(ChunkHashing &hashing)
+{
+    hashing.active = false;
+    hashing.generation++;
+    hashing.file = nullptr;
+    hashing.hashes.clear();
+}
+
+void DeviceEmulator::startNextFile()
+{
+    while (!sendStream && !pendingFiles.isEmpty()) {
+        QString filePath = pendingFiles.takeFirst();
+        sendStream = new QFile(filePath);
+        if (!sendStream->open(QIODevice::ReadOnly)) {
+            qWarning() << "Cannot open file for reading:" << filePath;
+            emit transferFailed(QFileInfo(filePath).fileName(), sendStream->errorString());
+            delete sendStream;
+            sendStream = nullptr;
+        }
+    }
+    if (!sendStream || !socket) {
         return;
     }
 
-    // Вычисляем размеры
-    qint64 originalSize = file.size();
-    qint64 blockCount = (originalSize + 7) / 8; // Количество полных блоков
-    qint64 paddedSize = blockCount * 8; // Размер с учётом дополнения
-    if (originalSize % 8 == 0) {
-        paddedSize += 8; // Добавляем блок дополнения для файлов, кратных 8
-        blockCount++;
+    // Крупный файл режется на более крупные куски, чтобы манифест не превысил предел получателя
+    sendSize = sendStream->size();
+    sendChunkSize = ChunkSize;
+    while (chunkCountFor(sendSize, sendChunkSize) > MaxManifestChunks && sendChunkSize < MaxChunkSize) {
+        sendChunkSize *= 2;
+    }
+    sendChunkCount = chunkCountFor(sendSize, sendChunkSize);
+    if (sendChunkCount > MaxManifestChunks) {
+        qWarning() << "File is too large:" << sendStream->fileName();
+        emit transferFailed(QFileInfo(*sendStream).fileName(), "Файл слишком велик");
+        abortSending();
+        startNextFile();
+        return;
     }
 
-    // Отправляем заголовок
-    QString filename = QFileInfo(file).fileName();
-    QString header = QString("FILE:%1:%2:%3\n").arg(filename).arg(originalSize).arg(paddedSize);
+    // Манифест: хэши всех кусков. По нему получатель сверяет то, что уже лежит у него
+    // от прерванной передачи, и запрашивает только недостающие куски. Пока он считается,
+    // куски не отправляются
+    waitingForRanges = true;
+    sendRanges.clear();
+    startHashing(sendHashing, sendStream, sendSize, sendChunkSize, &DeviceEmulator::sendFileHeader);
+}
+
+void DeviceEmulator::sendFileHeader(bool hashed)
+{
+    if (!hashed) {
+        qWarning() << "Cannot read file:" << sendStream->fileName();
+        emit transferFailed(QFileInfo(*sendStream).fileName(), sendStream->errorString());
+        abortSending();
+        startNextFile();
+        return;
+    }
+    QByteArray manifest = sendHashing.hashes;
+    sendHashing.hashes.clear();
+
+    // Гамма не требует дополнения: шифротекст той же длины, что и файл.
+    // Для каждой передачи свой IV, чтобы гамма никогда не повторялась под одним ключом,
+    // в том числе при досылке кусков после обрыва
+    sendIv = QRandomGenerator::system()->generate();
+    sendCipher.setKey(encryptionKey, sendIv);
+    sendBytesTotal = 0;
+    sendBytesDone = 0;
+    sendPercent = -1;
+
+    // Заголовок и сразу за ним манифест; куски уйдут после ответа RANGES
+    QString filename = QFileInfo(*sendStream).fileName();
+    QString header = QString("FILE:%1:%2:%3:%4\n").arg(filename).arg(sendSize)
+                         .arg(sendIv, 8, 16, QChar('0')).arg(sendChunkSize);
     socket->write(header.toUtf8());
-    socket->flush();
-
-    // Читаем и шифруем файл блоками по 8 байт
-    while (!file.atEnd()) {
-        QByteArray block = file.read(8);
-        qint64 bytesRead = block.size();
-        if (bytesRead < 8) {
-            // Добавляем PKCS#7 padding
-            char padValue = static_cast<char>(8 - bytesRead);
-            block.append(QByteArray(8 - bytesRead, padValue));
+    socket->write(manifest);
+}
+
+void DeviceEmulator::onRangesReceived(const QString &reply)
+{
+    // RANGES:<iv>:<a-b,c-d,...> — номера недостающих кусков включительно
+    QStringList parts = reply.split(':');
+    bool ok = parts.size() == 3;
+    quint32 iv = ok ? parts[1].toUInt(&ok, 16) : 0;
+    if (!ok || !sendStream || !waitingForRanges || sendHashing.active || iv != sendIv) {
+        qWarning() << "Unexpected ranges reply:" << reply;
+        return;
+    }
+
+    sendRanges.clear();
+    sendBytesTotal = 0;
+    const QStringList ranges = parts[2].split(',', Qt::SkipEmptyParts);
+    for (const QString &range : ranges) {
+        QStringList bounds = range.split('-');
+        bool ok1 = false, ok2 = false;
+        quint64 first = bounds.value(0).toULongLong(&ok1);
+        quint64 last = bounds.size() == 2 ? bounds[1].toULongLong(&ok2) : 0;
+        if (!ok1 || !ok2 || first > last || last >= sendChunkCount) {
+            qWarning() << "Invalid ranges reply:" << reply;
+            abortSending();
+            startNextFile();
+            return;
+        }
+        sendRanges.append(qMakePair(first, last));
+        for (quint64 i = first; i <= last; i++) {
+            sendBytesTotal += chunkLengthFor(sendSize, sendChunkSize, i);
         }
-        QByteArray encrypted = magma.encrypt(block);
-        socket->write(encrypted);
-        socket->flush();
     }
 
-    // Если размер файла кратен 8, добавляем полный блок дополнения
-    if (originalSize % 8 == 0) {
-        QByteArray paddingBlock(8, static_cast<char>(8));
-        QByteArray encrypted = magma.encrypt(paddingBlock);
-        socket->write(encrypted);
-        socket->flush();
+    waitingForRanges = false;
+    if (sendRanges.isEmpty()) {
+        qDebug() << "Receiver already has" << sendStream->fileName();
+        finishSending();
+        return;
     }
+    sendChunks();
+}
+
+void DeviceEmulator::sendChunks()
+{
+    // Следующий кусок готовится, только когда сокет отдал предыдущие: в буфере записи не
+    // больше MaxPendingBytes, остальное досылается из onBytesWritten
+    while (sendStream && !waitingForRanges && socket && socket->bytesToWrite() < MaxPendingBytes) {
+        quint64 index = sendRanges.first().first;
+        if (index == sendRanges.first().second) {
+            sendRanges.removeFirst();
+        } else {
+            sendRanges.first().first++;
+        }
 
-    file.close();
-    qDebug() << "File sent:" << filename << "Original size:" << originalSize << "Padded size:" << paddedSize;
+        // Кадр: строка CHUNK с номером, шифротекст и имитовставка к нему (encrypt-then-MAC).
+        // Даже пустой файл состоит из одного куска, чтобы признак последнего куска был всегда
+        qint64 offset = qint64(index) * sendChunkSize;
+        qint64 length = chunkLengthFor(sendSize, sendChunkSize, index);
+        bool last = index + 1 == sendChunkCount;
+        sendChunk.resize(int(length + MagmaCmac::TagSize));
+        uint8_t *data = reinterpret_cast<uint8_t *>(sendChunk.data());
+        if ((sendStream->pos() != offset && !sendStream->seek(offset))
+                || sendStream->read(sendChunk.data(), length) != length) {
+            qWarning() << "Cannot read file:" << sendStream->fileName();
+            emit transferFailed(QFileInfo(*sendStream).fileName(), sendStream->errorString());
+            abortSending();
+            socket->disconnectFromHost(); // Получатель не должен ждать оставшиеся куски
+            return;
+        }
+        sendCipher.apply(data, size_t(length), quint64(offset));
+        chunkTag(sendMac, sendIv, sendSize, index, last, data, size_t(length), data + length);
+        // Копия в буфер сокета, sendChunk переиспользуется для следующего куска
+        socket->write("CHUNK:" + QByteArray::number(index) + '\n');
+        socket->write(sendChunk.constData(), sendChunk.size());
+        sendBytesDone += length;
+
+        // Прогресс уходит в GUI только при смене процента, а не на каждый кусок
+        int percent = percentOf(sendBytesDone, sendBytesTotal);
+        if (percent != sendPercent) {
+            sendPercent = percent;
+            emit sendProgress(QFileInfo(*sendStream).fileName(), sendBytesDone, sendBytesTotal);
+        }
+
+        if (sendRanges.isEmpty()) {
+            finishSending();
+            return;
+        }
+    }
 }
 
-void DeviceEmulator::disconnect()
+void DeviceEmulator::finishSending()
 {
-    if (socket) {
-        socket->disconnectFromHost();
+    QString filename = QFileInfo(*sendStream).fileName();
+    qDebug() << "File sent:" << filename << "Size:" << sendSize << "Resent bytes:" << sendBytesDone;
+    sendStream->close();
+    delete sendStream;
+    sendStream = nullptr;
+    emit fileSent(filename);
+    startNextFile();
+}
+
+void DeviceEmulator::abortSending()
+{
+    cancelHashing(sendHashing);
+    if (sendStream) {
+        qDebug() << "File sending aborted:" << sendStream->fileName();
+        sendStream->close();
+        delete sendStream;
+        sendStream = nullptr;
+    }
+}
+
+void DeviceEmulator::interruptSending()
+{
+    // Прерванный файл встаёт в начало очереди и будет дослан после переподключения:
+    // получатель сохранил принятые куски и запросит только недостающие
+    cancelHashing(sendHashing);
+    if (sendStream) {
+        qDebug() << "File sending interrupted, will resume:" << sendStream->fileName();
+        pendingFiles.prepend(sendStream->fileName());
+        sendStream->close();
+        delete sendStream;
+        sendStream = nullptr;
     }
 }
 
-bool DeviceEmulator::isConnected() const
+void DeviceEmulator::onBytesWritten(qint64)
 {
-    return socket && socket->state() == QAbstractSocket::ConnectedState;
+    sendChunks();
 }
 
-void DeviceEmulator::onNewConnection()
+void DeviceEmulator::disconnect()
 {
     if (socket) {
         socket->disconnectFromHost();
-        socket->deleteLater();
     }
+}
+
+void DeviceEmulator::onNewConnection()
+{
+    releaseSocket();
 
     socket = server->nextPendingConnection();
     connect(socket, &QTcpSocket::readyRead, this, &DeviceEmulator::onReadyRead);
+    connect(socket, &QTcpSocket::bytesWritten, this, &DeviceEmulator::onBytesWritten);
     connect(socket, &QTcpSocket::disconnected, this, &DeviceEmulator::onDisconnected);
     connect(socket, &QTcpSocket::errorOccurred, this, &DeviceEmulator::onSocketError);
 
@@ -155,112 +499,312 @@ void DeviceEmulator::onNewConnection()
         ? QUuid("550e8400-e29b-41d4-a716-446655440000")
         : QUuid("550e8400-e29b-41d4-a716-446655440001");
 
+    established = true;
     emit connectionEstablished();
+
+    if (!sendStream) {
+        startNextFile();
+    }
 }
 
 void DeviceEmulator::onReadyRead()
 {
     if (!socket) return;
 
-    buffer += socket->readAll();
+    // Дочитываем прямо в хвост буфера: при сохранённой ёмкости без новых выделений памяти
+    qint64 available = socket->bytesAvailable();
+    if (available > 0) {
+        qsizetype size = buffer.size();
+        buffer.resize(size + available);
+        qint64 bytesRead = socket->read(buffer.data() + size, available);
+        buffer.resize(size + qMax<qint64>(bytesRead, 0));
+    }
 
-    while (!buffer.isEmpty()) {
+    // Разобранное отмечается смещением bufferOffset, а не удалением из начала буфера
+    while (bufferOffset < buffer.size()) {
         if (state == WaitingForHeader) {
-            int newlinePos = buffer.indexOf('\n');
+            qsizetype newlinePos = buffer.indexOf('\n', bufferOffset);
             if (newlinePos == -1) break; // Ждём полный заголовок
 
-            QByteArray headerData = buffer.left(newlinePos);
-            buffer.remove(0, newlinePos + 1);
-            QString header = QString::fromUtf8(headerData);
+            QString header = QString::fromUtf8(buffer.constData() + bufferOffset, newlinePos - bufferOffset);
+            bufferOffset = newlinePos + 1;
 
             if (header.startsWith("TEXT:")) {
                 QString message = header.mid(5);
                 emit dataReceived(message);
+            } else if (header.startsWith("RANGES:")) {
+                onRangesReceived(header);
+            } else if (header.startsWith("CHUNK:")) {
+                bool ok;
+                currentChunk = header.mid(6).toULongLong(&ok);
+                if (!ok || !fileStream || receiveHashing.active || currentChunk >= chunkCount
+                        || !missingChunks[currentChunk]) {
+                    qWarning() << "Unexpected chunk:" << header;
+                    abortReceiving();
+                    return;
+                }
+                state = ReceivingChunk;
             } else if (header.startsWith("FILE:")) {
+                // За заголовком идёт двоичный манифест, поэтому после ошибки разбор продолжать нельзя
                 QStringList parts = header.split(':');
-                if (parts.size() != 4) {
+                if (parts.size() != 5) {
                     qWarning() << "Invalid file header:" << header;
-                    break;
+                    abortReceiving();
+                    return;
                 }
 
+                // Новый файл вместо недопринятого: тот остаётся на диске для докачки
+                closeReceivedFile();
+
                 currentFilename = parts[1];
-                bool ok1, ok2;
+                bool ok1, ok2, ok3;
                 original_size = parts[2].toLongLong(&ok1);
-                encrypted_size = parts[3].toLongLong(&ok2);
+                receiveIv = parts[3].toUInt(&ok2, 16);
+                chunkSize = parts[4].toLongLong(&ok3);
 
-                if (!ok1 || !ok2 || original_size < 0 || encrypted_size < 0 || encrypted_size % 8 != 0) {
+                if (!ok1 || !ok2 || !ok3 || original_size < 0 || chunkSize <= 0 || chunkSize > MaxChunkSize
+                        || chunkCountFor(original_size, chunkSize) > MaxManifestChunks) {
                     qWarning() << "Invalid sizes in header:" << header;
-                    break;
+                    abortReceiving();
+                    return;
                 }
 
-                remainingBytes = encrypted_size;
-                state = ReceivingFile;
-
-                // Открываем файл для записи
-                fileStream = new QFile("received_" + currentFilename);
-                if (!fileStream->open(QIODevice::WriteOnly)) {
-                    qWarning() << "Cannot open file for writing:" << fileStream->fileName();
-                    delete fileStream;
-                    fileStream = nullptr;
-                    state = WaitingForHeader;
-                    break;
-                }
-                qDebug() << "Receiving file:" << currentFilename << "Original size:" << original_size << "Encrypted size:" << encrypted_size;
+                receiveCipher.setKey(encryptionKey, receiveIv);
+                chunkCount = chunkCountFor(original_size, chunkSize);
+                buffer.reserve(chunkSize + MagmaCmac::TagSize + ReadReserve);
+                state = ReadingManifest;
+                qDebug() << "Receiving file:" << currentFilename << "Size:" << original_size;
             } else {
+                // Строка пропущена целиком, граница следующего кадра известна: например, вторая
+                // строка многострочного TEXT не должна останавливать разбор уже принятых кадров
                 qWarning() << "Unknown header:" << header;
-                break;
             }
-        } else if (state == ReceivingFile) {
-            if (!fileStream) {
-                state = WaitingForHeader;
-                break;
+        } else if (state == ReadingManifest) {
+            qint64 manifestSize = qint64(chunkCount * MagmaCmac::TagSize);
+            if (buffer.size() - bufferOffset < manifestSize) {
+                break; // Ждём манифест целиком
+            }
+            receiveManifest = buffer.mid(bufferOffset, manifestSize);
+            bufferOffset += manifestSize;
+            state = WaitingForHeader;
+            requestMissingChunks();
+        } else if (state == ReceivingChunk) {
+            // Кусок расшифровывается и пишется на диск только после проверки имитовставки
+            qint64 length = chunkLengthFor(original_size, chunkSize, currentChunk);
+            if (buffer.size() - bufferOffset < length + qint64(MagmaCmac::TagSize)) {
+                break; // Ждём кусок целиком
+            }
+
+            // Кусок расшифровывается на месте и уходит в файл одной записью на своё место
+            uint8_t *data = reinterpret_cast<uint8_t *>(buffer.data() + bufferOffset);
+            bool last = currentChunk + 1 == chunkCount;
+            uint8_t tag[MagmaCmac::TagSize];
+            chunkTag(receiveMac, receiveIv, original_size, currentChunk, last, data, size_t(length), tag);
+            if (!tagsEqual(tag, data + length)) {
+                qWarning() << "Chunk" << currentChunk << "of" << currentFilename << "failed authentication";
+                QString filename = currentFilename;
+                abortReceiving();
+                emit fileRejected(filename);
+                return;
             }
 
-            while (remainingBytes >= 8 && buffer.size() >= 8) {
-                QByteArray encryptedBlock = buffer.left(8);
-                buffer.remove(0, 8);
-                QByteArray decryptedBlock = magma.decrypt(encryptedBlock);
-                fileStream->write(decryptedBlock);
-                remainingBytes -= 8;
+            qint64 offset = qint64(currentChunk) * chunkSize;
+            receiveCipher.apply(data, size_t(length), quint64(offset));
+            if (!fileStream->seek(offset)
+                    || fileStream->write(reinterpret_cast<const char *>(data), length) != length) {
+                qWarning() << "Cannot write file:" << fileStream->fileName();
+                QString filename = currentFilename;
+                QString reason = fileStream->errorString();
+                abortReceiving();
+                emit transferFailed(filename, reason);
+                return;
+            }
+            bufferOffset += length + MagmaCmac::TagSize;
+            missingChunks[currentChunk] = false;
+            missingCount--;
+            receivedBytes += length;
+            state = WaitingForHeader;
+
+            int percent = percentOf(receivedBytes, neededBytes);
+            if (percent != receivePercent) {
+                receivePercent = percent;
+                emit receiveProgress(currentFilename, receivedBytes, neededBytes);
             }
 
-            if (remainingBytes == 0) {
-                // Усекаем файл до оригинального размера
-                fileStream->resize(original_size);
-                fileStream->close();
-                qDebug() << "File received:" << currentFilename << "Size:" << original_size;
-                emit fileReceived(fileStream->fileName());
-                delete fileStream;
-                fileStream = nullptr;
-                state = WaitingForHeader;
+            if (missingCount == 0) {
+                finishReceivedFile();
             }
         }
     }
+
+    // Неразобранный хвост переносится в начало один раз за вызов; ёмкость буфера сохраняется
+    if (bufferOffset == buffer.size()) {
+        buffer.resize(0);
+    } else if (bufferOffset > 0) {
+        buffer.remove(0, bufferOffset);
+    }
+    bufferOffset = 0;
 }
 
-void DeviceEmulator::onDisconnected()
+void DeviceEmulator::requestMissingChunks()
 {
-    if (state == ReceivingFile && fileStream) {
-        fileStream->close();
-        fileStream->remove(); // Удаляем частично полученный файл
-        qDebug() << "Removed incomplete file:" << fileStream->fileName();
+    // Куски копятся в .part-файле, который переживает обрыв соединения
+    fileStream = new QFile("received_" + currentFilename + ".part");
+    if (!fileStream->open(QIODevice::ReadWrite)) {
+        qWarning() << "Cannot open file for writing:" << fileStream->fileName();
+        emit transferFailed(currentFilename, fileStream->errorString());
         delete fileStream;
         fileStream = nullptr;
+        abortReceiving(); // Отправитель не должен ждать ответа RANGES
+        return;
+    }
+    if (fileStream->size() > original_size) {
+        fileStream->resize(original_size);
+    }
+
+    // Уже принятыми считаются куски, чей хэш совпал с манифестом; остальные запрашиваются.
+    // Пока .part-файл хэшируется, отправитель ждёт RANGES и куски не шлёт
+    if (fileStream->size() > 0 || original_size == 0) {
+        startHashing(receiveHashing, fileStream, original_size, chunkSize, &DeviceEmulator::sendMissingRanges);
+    } else {
+        sendMissingRanges(false);
+    }
+}
+
+void DeviceEmulator::sendMissingRanges(bool hashed)
+{
+    if (!hashed && receiveHashing.file) {
+        qWarning() << "Cannot read partial file:" << fileStream->fileName();
+    }
+    const QByteArray hashes = receiveHashing.hashes;
+    cancelHashing(receiveHashing);
+
+    missingChunks.assign(chunkCount, true);
+    missingCount = chunkCount;
+    receivedBytes = 0;
+    neededBytes = 0;
+    receivePercent = -1;
+    QStringList ranges;
+    quint64 rangeStart = 0;
+    for (quint64 i = 0; i <= chunkCount; i++) {
+        if (i < chunkCount) {
+            qint64 length = chunkLengthFor(original_size, chunkSize, i);
+            bool present = hashed && qint64(i) * chunkSize + length <= fileStream->size()
+                && tagsEqual(reinterpret_cast<const uint8_t *>(hashes.constData()) + i * MagmaCmac::TagSize,
+                             reinterpret_cast<const uint8_t *>(receiveManifest.constData()) + i * MagmaCmac::TagSize);
+            if (present) {
+                missingChunks[i] = false;
+                missingCount--;
+            } else {
+                neededBytes += length;
+            }
+        }
+        // Подряд идущие недостающие куски сворачиваются в диапазон a-b
+        bool missing = i < chunkCount && missingChunks[i];
+        bool wasMissing = i > 0 && missingChunks[i - 1];
+        if (missing && !wasMissing) {
+            rangeStart = i;
+        } else if (!missing && wasMissing) {
+            ranges.append(QString("%1-%2").arg(rangeStart).arg(i - 1));
+        }
+    }
+
+    if (missingCount < chunkCount) {
+        qDebug() << "Resuming" << currentFilename << ":" << chunkCount - missingCount << "of" << chunkCount
+                 << "chunks already received";
+    }
+    if (socket) {
+        socket->write(QString("RANGES:%1:%2\n").arg(receiveIv, 8, 16, QChar('0')).arg(ranges.join(',')).toUtf8());
+    }
+
+    if (missingCount == 0) {
+        finishReceivedFile();
     }
+}
+
+void DeviceEmulator::finishReceivedFile()
+{
+    // Все куски на месте: .part-файл становится полученным файлом
+    QString partName = fileStream->fileName();
+    QString fileName = "received_" + currentFilename;
+    fileStream->close();
+    delete fileStream;
+    fileStream = nullptr;
     state = WaitingForHeader;
-    emit connectionLost();
+
+    QFile::remove(fileName);
+    if (!QFile::rename(partName, fileName)) {
+        qWarning() << "Cannot rename" << partName << "to" << fileName;
+        emit transferFailed(currentFilename, "Не удалось переименовать " + partName);
+        return;
+    }
+    qDebug() << "File received:" << currentFilename << "Size:" << original_size;
+    emit fileReceived(fileName);
 }
 
-void DeviceEmulator::onSocketError(QAbstractSocket::SocketError error)
+void DeviceEmulator::closeReceivedFile()
 {
-    qWarning() << "Socket error:" << error;
-    if (state == ReceivingFile && fileStream) {
+    cancelHashing(receiveHashing);
+    if (fileStream) {
         fileStream->close();
-        fileStream->remove();
-        qDebug() << "Removed incomplete file due to socket error:" << fileStream->fileName();
+        qDebug() << "Partial file kept for resume:" << fileStream->fileName();
         delete fileStream;
         fileStream = nullptr;
     }
     state = WaitingForHeader;
-    emit connectionLost();
+}
+
+void DeviceEmulator::abortReceiving()
+{
+    // Проверенные куски остаются в .part-файле, при следующей передаче они не повторяются
+    closeReceivedFile();
+    buffer.clear();
+    bufferOffset = 0;
+
+    // После сбоя границы кадров в потоке не известны, продолжать нельзя
+    if (socket) {
+        socket->disconnectFromHost();
+    }
+}
+
+void DeviceEmulator::onDisconnected()
+{
+    connectionClosed();
+}
+
+void DeviceEmulator::onSocketError(QAbstractSocket::SocketError error)
+{
+    qWarning() << "Socket error:" << error;
+    if (!connectingUuid.isNull()) {
+        // Соединение не было установлено, терять нечего
+        connectingUuid = QUuid();
+        emit connectionFailed(socket->errorString());
+        return;
+    }
+    connectionClosed();
+}
+
+void DeviceEmulator::connectionClosed()
+{
+    closeReceivedFile();
+    buffer.clear();
+    bufferOffset = 0;
+    interruptSending();
+    if (established) {
+        established = false;
+        emit connectionLost();
+    }
+}
+
+void DeviceEmulator::releaseSocket()
+{
+    if (!socket) {
+        return;
+    }
+    socket->disconnect(this);
+    socket->disconnectFromHost();
+    socket->deleteLater();
+    socket = nullptr;
+    connectingUuid = QUuid();
+    connectionClosed();
 }
@@ -6,8 +6,15 @@
 #include <QTcpSocket>
 #include <QUuid>
 #include <QFile>
-#include "magma.h"
+#include <QStringList>
+#include <QList>
+#include <QPair>
+#include <vector>
+#include "magmactr.h"
+#include "magmacmac.h"
 
+// Сокеты, шифрование и работа с файлами. Объект живёт в отдельном потоке: GUI вызывает
+// слоты через queued-соединения и получает результаты сигналами
 class DeviceEmulator : public QObject
 {
     Q_OBJECT
@@ -16,39 +23,161 @@ public:
     explicit DeviceEmulator(const QString &userType, QObject *parent = nullptr);
     ~DeviceEmulator();
 
-    bool connectToDevice(const QString &uuid);
+public slots:
+    // Запуск сервера; вызывается после переноса объекта в рабочий поток
+    void start();
+    void connectToDevice(const QString &uuid);
     void sendData(const QString &data);
     void sendFile(const QString &filePath);
     void disconnect();
-    bool isConnected() const;
 
 signals:
     void dataReceived(const QString &data);
     void fileReceived(const QString &filename);
+    // Файл целиком передан сокету
+    void fileSent(const QString &filename);
     void connectionEstablished();
+    void connectionFailed(const QString &reason);
     void connectionLost();
+    // Прогресс передачи, не чаще одного раза на процент
+    void sendProgress(const QString &filename, qint64 bytes, qint64 total);
+    void receiveProgress(const QString &filename, qint64 bytes, qint64 total);
+    // Ошибка чтения или записи файла; передача прервана
+    void transferFailed(const QString &filename, const QString &reason);
+    // Кусок файла не прошёл проверку имитовставки; проверенные ранее куски сохранены
+    void fileRejected(const QString &filename);
 
 private slots:
     void onNewConnection();
+    void onConnected();
     void onReadyRead();
+    void onBytesWritten(qint64 bytes);
     void onDisconnected();
     void onSocketError(QAbstractSocket::SocketError error);
 
 private:
+    // Протокол файла: FILE-заголовок и манифест (хэши всех кусков), ответ получателя
+    // RANGES с недостающими кусками, затем кадры CHUNK — номер, шифротекст и имитовставка.
+    // Размер куска отправителя; файлы, которым не хватает MaxManifestChunks кусков, режутся крупнее
+    static const qint64 ChunkSize = 256 * 1024;
+    // Предел неотправленных данных в буфере сокета при передаче файла
+    static const qint64 MaxPendingBytes = 2 * ChunkSize;
+    // Запас ёмкости приёмного буфера сверх куска под данные, пришедшие вместе с ним
+    static const qint64 ReadReserve = 64 * 1024;
+    // Время на установку соединения, мс
+    static const int ConnectTimeout = 3000;
+    // Больший размер куска из заголовка отвергается, чтобы не копить в буфере лишнее
+    static const qint64 MaxChunkSize = 1024 * 1024;
+    // Предел числа кусков в манифесте (8 МиБ хэшей). Вместе с MaxChunkSize ограничивает
+    // размер файла 1 ТиБ; больший файл отправитель отвергает сам, не начиная передачу
+    static const quint64 MaxManifestChunks = 1024 * 1024;
+    // Объём файла, читаемый и хэшируемый за один проход цикла событий
+    static const qint64 ManifestBatchBytes = 8 * 1024 * 1024;
+
+    // Подсчёт хэшей кусков, целиком лежащих в file, по пачке за проход цикла событий:
+    // между пачками поток эмулятора обслуживает сокет и вызовы из GUI
+    struct ChunkHashing
+    {
+        QFile *file = nullptr;
+        qint64 fileSize = 0;
+        qint64 chunkSize = 0;
+        quint64 next = 0;     // Первый ещё не хэшированный кусок
+        quint64 complete = 0; // Число кусков, целиком лежащих в файле
+        QByteArray hashes;    // Хэши остальных кусков остаются нулевыми
+        bool active = false;
+        // Меняется при отмене, чтобы отложенная пачка не продолжила прерванный подсчёт
+        int generation = 0;
+    };
+
+    // Ключ для конкретного назначения, выработанный из общего ключа
+    static QByteArray deriveKey(const QByteArray &key, uint8_t label);
+    // Имитовставка куска: IV, размер файла, номер куска и признак последнего куска
+    // не дают переставить, повторить или отрезать куски
+    static void chunkTag(MagmaCmac &mac, quint32 iv, qint64 fileSize, quint64 index, bool last,
+                         const uint8_t *data, size_t size, uint8_t *tag);
+    // Хэш куска открытого текста для манифеста
+    static void chunkHash(MagmaCmac &mac, quint64 index, const uint8_t *data, size_t size, uint8_t *hash);
+    // Запускает подсчёт; done(true) вызывается, когда hashing.hashes готовы, done(false) — при ошибке чтения
+    void startHashing(ChunkHashing &hashing, QFile *file, qint64 fileSize, qint64 chunkSize,
+                      void (DeviceEmulator::*done)(bool));
+    void scheduleHashBatch(ChunkHashing &hashing, void (DeviceEmulator::*done)(bool));
+    bool hashBatch(ChunkHashing &hashing);
+    void cancelHashing(ChunkHashing &hashing);
+
+    void startNextFile();
+    // Манифест посчитан: отправка заголовка и манифеста
+    void sendFileHeader(bool hashed);
+    void onRangesReceived(const QString &reply);
+    void sendChunks();
+    void finishSending();
+    // Бросает текущий файл
+    void abortSending();
+    // Возвращает текущий файл в очередь для досылки после переподключения
+    void interruptSending();
+
+    // Сверяет .part-файл с манифестом и отправляет RANGES с недостающими кусками
+    void requestMissingChunks();
+    void sendMissingRanges(bool hashed);
+    void finishReceivedFile();
+    // Закрывает недопринятый файл, оставляя его для докачки
+    void closeReceivedFile();
+    // То же и разрыв соединения после ошибки в потоке
+    void abortReceiving();
+    // Соединение потеряно: передачи откладываются до переподключения
+    void connectionClosed();
+    // Отключает сигналы текущего сокета и закрывает его; запоздалые ошибки старого
+    // сокета не должны относиться к новому соединению
+    void releaseSocket();
+
     QTcpServer *server;
     QTcpSocket *socket;
     QString userType;
     QUuid localUuid;
     QUuid remoteUuid;
+    QUuid connectingUuid; // Устройство, к которому идёт подключение
+    // Соединение установлено, и о его потере ещё не сообщалось: ошибка сокета и следующий
+    // за ней disconnected дают один сигнал connectionLost
+    bool established;
     QMap<QUuid, quint16> uuidToPortMap;
-    Magma magma;
+    QByteArray encryptionKey;
+    QByteArray macKey;
+    MagmaCmac manifestMac;
+    // Отправка файла: очередь, текущий файл и запрошенные получателем куски
+    QStringList pendingFiles;
+    QFile *sendStream;
+    ChunkHashing sendHashing;
+    qint64 sendChunkSize;
+    MagmaCtr sendCipher;
+    MagmaCmac sendMac;
+    quint32 sendIv;
+    qint64 sendSize;
+    quint64 sendChunkCount;
+    bool waitingForRanges;
+    QList<QPair<quint64, quint64>> sendRanges; // Диапазоны номеров кусков, включительно
+    qint64 sendBytesTotal;
+    qint64 sendBytesDone;
+    int sendPercent;
+    QByteArray sendChunk;
+
+    MagmaCtr receiveCipher;
+    MagmaCmac receiveMac;
+    quint32 receiveIv;
+    qint64 chunkSize;
+    quint64 chunkCount;
+    quint64 currentChunk;
+    QByteArray receiveManifest;
+    ChunkHashing receiveHashing;
+    std::vector<bool> missingChunks;
+    quint64 missingCount;
+    qint64 receivedBytes;
+    qint64 neededBytes;
+    int receivePercent;
     QByteArray buffer;
-    enum State { WaitingForHeader, ReceivingFile } state;
+    qsizetype bufferOffset; // Начало неразобранных данных в buffer
+    enum State { WaitingForHeader, ReadingManifest, ReceivingChunk } state;
     QString currentFilename;
     qint64 original_size;
-    qint64 encrypted_size;
-    qint64 remainingBytes;
-    QFile *fileStream;
+    QFile *fileStream; // .part-файл принимаемого файла
 };
 
 #endif // DEVICEEMULATOR_H
@@ -2,7 +2,15 @@
 #define MAGMA_H
 
 #include <QByteArray>
-#include <vector>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Векторное ядро AVX2 собирается только там, где компилятор умеет target-атрибуты и
+// проверку возможностей процессора во время работы
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MAGMA_HAVE_AVX2
+#endif
 
 class Magma {
 public:
@@ -11,11 +19,26 @@ public:
     QByteArray encrypt(const QByteArray &block);
     QByteArray decrypt(const QByteArray &block);
 
+    // Пакетная обработка n блоков по 8 байт без выделения памяти; in и out могут совпадать
+    void encryptBlocks(const uint8_t *in, uint8_t *out, size_t n) const;
+    void decryptBlocks(const uint8_t *in, uint8_t *out, size_t n) const;
+
 private:
-    std::vector<uint32_t> subkeys;
-    static const uint8_t sboxes[8][16];
-    uint32_t G(uint32_t a, uint32_t k);
-    uint32_t t(uint32_t a);
+    std::array<uint32_t, 32> subkeys;
+    std::array<uint32_t, 32> decryptSubkeys; // Те же ключи в обратном порядке
+    // Раундовая функция: подстановка и циклический сдвиг на 11 бит через таблицы по байтам
+    static uint32_t G(uint32_t a, uint32_t k);
+
+    // Выбирает векторное ядро, если процессор его поддерживает, остаток — скалярно
+    static void cryptBlocks(const std::array<uint32_t, 32> &keys, const uint8_t *in, uint8_t *out, size_t n);
+    static void cryptBlocksScalar(const std::array<uint32_t, 32> &keys, const uint8_t *in, uint8_t *out, size_t n);
+#ifdef MAGMA_HAVE_AVX2
+    static const size_t Avx2Blocks = 8;
+    // n должно быть кратно Avx2Blocks
+    static void cryptBlocksAvx2(const uint32_t *keys, const uint8_t *in, uint8_t *out, size_t n);
+    // Поддержка AVX2 процессором и самопроверка ядра; вызывается один раз
+    static bool avx2Usable();
+#endif
 };
 
 #endif // MAGMA_H
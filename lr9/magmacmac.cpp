@@ -0,0 +1,74 @@
+#include "magmacmac.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Сдвиг 64-битной строки влево на 1 с приведением по многочлену B64 = 0x1B
+void shiftSubkey(const uint8_t *in, uint8_t *out)
+{
+    uint8_t carry = in[0] >> 7;
+    for (int i = 0; i < 7; i++) {
+        out[i] = uint8_t((in[i] << 1) | (in[i + 1] >> 7));
+    }
+    out[7] = uint8_t(in[7] << 1);
+    if (carry) {
+        out[7] ^= 0x1B;
+    }
+}
+
+} // namespace
+
+MagmaCmac::MagmaCmac() : k1{}, k2{}, state{}, pending{}, pendingSize(0) {}
+
+void MagmaCmac::setKey(const QByteArray &key)
+{
+    cipher.setKey(key);
+
+    // Вспомогательные ключи: R = E(0), K1 = R << 1, K2 = K1 << 1
+    uint8_t r[8] = {};
+    cipher.encryptBlocks(r, r, 1);
+    shiftSubkey(r, k1);
+    shiftSubkey(k1, k2);
+    reset();
+}
+
+void MagmaCmac::reset()
+{
+    std::memset(state, 0, sizeof(state));
+    pendingSize = 0;
+}
+
+void MagmaCmac::update(const uint8_t *data, size_t size)
+{
+    while (size > 0) {
+        if (pendingSize == 8) {
+            for (int i = 0; i < 8; i++) {
+                state[i] ^= pending[i];
+            }
+            cipher.encryptBlocks(state, state, 1);
+            pendingSize = 0;
+        }
+        size_t count = std::min(size, 8 - pendingSize);
+        std::memcpy(pending + pendingSize, data, count);
+        pendingSize += count;
+        data += count;
+        size -= count;
+    }
+}
+
+void MagmaCmac::final(uint8_t *tag)
+{
+    // Полный последний блок маскируется K1, неполный дополняется 10..0 и маскируется K2
+    const uint8_t *mask = k1;
+    if (pendingSize < 8) {
+        pending[pendingSize] = 0x80;
+        std::memset(pending + pendingSize + 1, 0, 8 - pendingSize - 1);
+        mask = k2;
+    }
+    for (int i = 0; i < 8; i++) {
+        state[i] ^= pending[i] ^ mask[i];
+    }
+    cipher.encryptBlocks(state, tag, 1);
+    reset();
+}
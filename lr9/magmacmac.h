@@ -0,0 +1,33 @@
+#ifndef MAGMACMAC_H
+#define MAGMACMAC_H
+
+#include <QByteArray>
+#include <cstddef>
+#include <cstdint>
+#include "magma.h"
+
+// Режим выработки имитовставки (CMAC) ГОСТ Р 34.13-2015 для Magma. Данные подаются
+// частями через update, имитовставка длиной в блок (8 байт) получается в final.
+class MagmaCmac {
+public:
+    MagmaCmac();
+    void setKey(const QByteArray &key);
+
+    // Начинает новое сообщение под тем же ключом
+    void reset();
+    void update(const uint8_t *data, size_t size);
+    void final(uint8_t *tag);
+
+    static const size_t TagSize = 8;
+
+private:
+    Magma cipher;
+    uint8_t k1[8];
+    uint8_t k2[8];
+    uint8_t state[8];
+    // Последний блок не шифруется, пока неизвестно, что он последний
+    uint8_t pending[8];
+    size_t pendingSize;
+};
+
+#endif // MAGMACMAC_H
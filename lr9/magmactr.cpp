@@ -0,0 +1,140 @@
+#include "magmactr.h"
+#include <QDebug>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <algorithm>
+
+namespace {
+
+// Блоков гаммы за один вызов encryptBlocks: буфер остаётся на стеке
+const size_t KeystreamBlocks = 64;
+
+// Константа D функции ACPKM: байты 0x80..0x9F
+const uint8_t acpkmConstant[32] = {
+    0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8A, 0x8B, 0x8C, 0x8D, 0x8E, 0x8F,
+    0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0x9B, 0x9C, 0x9D, 0x9E, 0x9F
+};
+
+// Участок буфера, который обрабатывает одна задача пула
+struct Span
+{
+    uint8_t *data;
+    size_t size;
+    quint64 offset;
+};
+
+} // namespace
+
+MagmaCtr::MagmaCtr() : iv(0), sectionSize(0), firstSection(0) {}
+
+void MagmaCtr::setKey(const QByteArray &key, quint32 iv, size_t sectionSize)
+{
+    if (sectionSize % 8 != 0) {
+        qWarning() << "ACPKM section size must be a multiple of the block size:" << sectionSize;
+        sectionSize = DefaultSectionSize;
+    }
+    baseKey = key;
+    this->iv = iv;
+    this->sectionSize = sectionSize;
+    firstSection = 0;
+    sectionCiphers.assign(1, Magma());
+    sectionCiphers.front().setKey(key);
+}
+
+QByteArray MagmaCtr::acpkm(const Magma &cipher)
+{
+    QByteArray key(32, 0);
+    cipher.encryptBlocks(acpkmConstant, reinterpret_cast<uint8_t *>(key.data()), 4);
+    return key;
+}
+
+void MagmaCtr::prepareSections(quint64 first, quint64 last)
+{
+    // Ключ секции j получается j-кратным применением ACPKM, поэтому вернуться назад
+    // можно только от исходного ключа
+    if (first < firstSection) {
+        firstSection = 0;
+        sectionCiphers.assign(1, Magma());
+        sectionCiphers.front().setKey(baseKey);
+    }
+
+    // Секции до first больше не нужны
+    while (firstSection < first) {
+        if (sectionCiphers.size() > 1) {
+            sectionCiphers.erase(sectionCiphers.begin());
+        } else {
+            sectionCiphers.front().setKey(acpkm(sectionCiphers.front()));
+        }
+        firstSection++;
+    }
+    while (firstSection + sectionCiphers.size() - 1 < last) {
+        Magma next;
+        next.setKey(acpkm(sectionCiphers.back()));
+        sectionCiphers.push_back(next);
+    }
+}
+
+void MagmaCtr::apply(uint8_t *data, size_t size, quint64 offset)
+{
+    if (size == 0) {
+        return;
+    }
+    if (sectionCiphers.empty()) {
+        qWarning() << "MagmaCtr: key is not set";
+        return;
+    }
+
+    if (sectionSize > 0) {
+        prepareSections(offset / sectionSize, (offset + size - 1) / sectionSize);
+    }
+
+    int threads = QThreadPool::globalInstance()->maxThreadCount();
+    if (size < ParallelThreshold || threads < 2) {
+        applySerial(data, size, offset);
+        return;
+    }
+
+    // Участки выровнены по блоку, чтобы ни один блок гаммы не вычислялся дважды
+    size_t part = std::max(ParallelThreshold / 2, (size / threads + 7) & ~size_t(7));
+    std::vector<Span> spans;
+    for (size_t done = 0; done < size; done += part) {
+        spans.push_back({ data + done, std::min(part, size - done), offset + done });
+    }
+    QtConcurrent::blockingMap(spans, [this](const Span &span) {
+        applySerial(span.data, span.size, span.offset);
+    });
+}
+
+void MagmaCtr::applySerial(uint8_t *data, size_t size, quint64 offset) const
+{
+    uint8_t keystream[KeystreamBlocks * 8];
+    while (size > 0) {
+        // Внутри одной секции ключ не меняется
+        quint64 section = sectionSize > 0 ? offset / sectionSize : 0;
+        const Magma &cipher = sectionCiphers[section - (sectionSize > 0 ? firstSection : 0)];
+        quint64 sectionEnd = sectionSize > 0 ? (section + 1) * sectionSize : ~quint64(0);
+        size_t length = size_t(std::min<quint64>(size, sectionEnd - offset));
+
+        quint64 block = offset / 8;
+        size_t skip = size_t(offset % 8);
+        size_t blocks = std::min(KeystreamBlocks, (skip + length + 7) / 8);
+
+        // Счётчик: IV в старшей половине, номер блока — в младшей (по модулю 2^64)
+        quint64 counterBase = (quint64(iv) << 32) + block;
+        for (size_t i = 0; i < blocks; i++) {
+            quint64 counter = counterBase + i;
+            for (int b = 0; b < 8; b++) {
+                keystream[i * 8 + b] = uint8_t(counter >> (56 - 8 * b));
+            }
+        }
+        cipher.encryptBlocks(keystream, keystream, blocks);
+
+        size_t count = std::min(length, blocks * 8 - skip);
+        for (size_t i = 0; i < count; i++) {
+            data[i] ^= keystream[skip + i];
+        }
+        data += count;
+        size -= count;
+        offset += count;
+    }
+}
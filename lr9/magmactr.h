@@ -0,0 +1,41 @@
+#ifndef MAGMACTR_H
+#define MAGMACTR_H
+
+#include <QByteArray>
+#include <QtGlobal>
+#include <vector>
+#include "magma.h"
+
+// Режим гаммирования (CTR) ГОСТ Р 34.13-2015 для Magma с необязательной сменой ключа
+// ACPKM (Р 1323565.1.017-2018): после каждой секции sectionSize байт ключ заменяется
+// на ACPKM(K), счётчик при этом продолжается. Шифрование и расшифрование совпадают.
+class MagmaCtr {
+public:
+    MagmaCtr();
+    // sectionSize кратен 8; 0 — обычный CTR без смены ключа
+    void setKey(const QByteArray &key, quint32 iv, size_t sectionSize = DefaultSectionSize);
+
+    // Накладывает гамму на data так, будто data начинается с позиции offset потока.
+    // Позиция задаётся явно, поэтому куски потока можно обрабатывать в любом порядке.
+    // Большие буферы делятся между потоками глобального QThreadPool
+    void apply(uint8_t *data, size_t size, quint64 offset);
+
+    static const size_t DefaultSectionSize = 16 * 1024;
+    // Меньшие буферы обрабатываются в вызывающем потоке: запуск задач дороже самой гаммы
+    static const size_t ParallelThreshold = 64 * 1024;
+
+private:
+    void prepareSections(quint64 first, quint64 last);
+    void applySerial(uint8_t *data, size_t size, quint64 offset) const;
+    static QByteArray acpkm(const Magma &cipher);
+
+    QByteArray baseKey;
+    quint32 iv;
+    size_t sectionSize;
+    // Ключи секций начиная с firstSection, нужные текущему вызову apply. Следующий вызов
+    // обычно продолжает поток и наращивает их от последней секции, а не от исходного ключа
+    quint64 firstSection;
+    std::vector<Magma> sectionCiphers;
+};
+
+#endif // MAGMACTR_H
@@ -40,7 +40,16 @@ MainWindow::MainWindow(const QString &userType, QWidget *parent)
     setWindowTitle(QString("Bluetooth эмулятор - Пользователь %1").arg(userType));
     resize(500, 400);
 
-    deviceEmulator = new DeviceEmulator(userType, this);
+    // Эмулятор со всей криптографией и файлами работает в своём потоке, GUI не ждёт передачу
+    emulatorThread = new QThread(this);
+    deviceEmulator = new DeviceEmulator(userType);
+    deviceEmulator->moveToThread(emulatorThread);
+    connect(emulatorThread, &QThread::started, deviceEmulator, &DeviceEmulator::start);
+    connect(emulatorThread, &QThread::finished, deviceEmulator, &QObject::deleteLater);
+    connect(this, &MainWindow::connectRequested, deviceEmulator, &DeviceEmulator::connectToDevice);
+    connect(this, &MainWindow::sendDataRequested, deviceEmulator, &DeviceEmulator::sendData);
+    connect(this, &MainWindow::sendFileRequested, deviceEmulator, &DeviceEmulator::sendFile);
+    connect(this, &MainWindow::disconnectRequested, deviceEmulator, &DeviceEmulator::disconnect);
 
     connect(scanButton, &QPushButton::clicked, this, &MainWindow::on_scanButton_clicked);
     connect(sendButton, &QPushButton::clicked, this, &MainWindow::on_sendButton_clicked);
@@ -48,8 +57,15 @@ MainWindow::MainWindow(const QString &userType, QWidget *parent)
     connect(disconnectButton, &QPushButton::clicked, this, &MainWindow::on_disconnectButton_clicked);
     connect(deviceEmulator, &DeviceEmulator::dataReceived, this, &MainWindow::onDataReceived);
     connect(deviceEmulator, &DeviceEmulator::fileReceived, this, &MainWindow::onFileReceived);
+    connect(deviceEmulator, &DeviceEmulator::fileSent, this, &MainWindow::onFileSent);
+    connect(deviceEmulator, &DeviceEmulator::fileRejected, this, &MainWindow::onFileRejected);
     connect(deviceEmulator, &DeviceEmulator::connectionEstablished, this, &MainWindow::onConnectionEstablished);
+    connect(deviceEmulator, &DeviceEmulator::connectionFailed, this, &MainWindow::onConnectionFailed);
     connect(deviceEmulator, &DeviceEmulator::connectionLost, this, &MainWindow::onConnectionLost);
+    connect(deviceEmulator, &DeviceEmulator::sendProgress, this, &MainWindow::onSendProgress);
+    connect(deviceEmulator, &DeviceEmulator::receiveProgress, this, &MainWindow::onReceiveProgress);
+    connect(deviceEmulator, &DeviceEmulator::transferFailed, this, &MainWindow::onTransferFailed);
+    emulatorThread->start();
 
     sendButton->setEnabled(false);
     sendFileButton->setEnabled(false);
@@ -58,7 +74,9 @@ MainWindow::MainWindow(const QString &userType, QWidget *parent)
 
 MainWindow::~MainWindow()
 {
-    delete deviceEmulator;
+    // Эмулятор удаляется в своём потоке по сигналу finished
+    emulatorThread->quit();
+    emulatorThread->wait();
 }
 
 void MainWindow::on_scanButton_clicked()
@@ -72,7 +90,7 @@ void MainWindow::on_sendButton_clicked()
 {
     QString message = messageEdit->text();
     if (!message.isEmpty()) {
-        deviceEmulator->sendData(message);
+        emit sendDataRequested(message);
         chatDisplay->append(QString("[Вы]: %1").arg(message));
         messageEdit->clear();
     }
@@ -80,31 +98,24 @@ void MainWindow::on_sendButton_clicked()
 
 void MainWindow::on_sendFileButton_clicked()
 {
-    if (!deviceEmulator->isConnected()) {
-        statusBar->showMessage("Не подключено", 3000);
-        return;
-    }
-
     QString filePath = QFileDialog::getOpenFileName(this, "Выберите файл для отправки");
     if (!filePath.isEmpty()) {
-        deviceEmulator->sendFile(filePath);
-        chatDisplay->append(QString("Отправлен файл: %1").arg(QFileInfo(filePath).fileName()));
+        emit sendFileRequested(filePath);
+        chatDisplay->append(QString("Отправка файла: %1").arg(QFileInfo(filePath).fileName()));
     }
 }
 
 void MainWindow::on_disconnectButton_clicked()
 {
-    deviceEmulator->disconnect();
+    emit disconnectRequested();
 }
 
 void MainWindow::onDeviceSelected(const QString &uuid)
 {
-    if (deviceEmulator->connectToDevice(uuid)) {
-        connectedDeviceName = (uuid == "550e8400-e29b-41d4-a716-446655440000") ? "Устройство A" : "Устройство B";
-        statusBar->showMessage(QString("Подключение к %1...").arg(connectedDeviceName));
-    } else {
-        statusBar->showMessage("Ошибка подключения", 3000);
-    }
+    // Результат подключения придёт сигналом connectionEstablished или connectionFailed
+    connectedDeviceName = (uuid == "550e8400-e29b-41d4-a716-446655440000") ? "Устройство A" : "Устройство B";
+    statusBar->showMessage(QString("Подключение к %1...").arg(connectedDeviceName));
+    emit connectRequested(uuid);
 }
 
 void MainWindow::onDataReceived(const QString &data)
@@ -117,6 +128,16 @@ void MainWindow::onFileReceived(const QString &filename)
     chatDisplay->append(QString("Файл получен: %1").arg(filename));
 }
 
+void MainWindow::onFileSent(const QString &filename)
+{
+    chatDisplay->append(QString("Отправлен файл: %1").arg(filename));
+}
+
+void MainWindow::onFileRejected(const QString &filename)
+{
+    chatDisplay->append(QString("Файл повреждён при передаче, приём прерван: %1").arg(filename));
+}
+
 void MainWindow::onConnectionEstablished()
 {
     connectionStatus->setText(QString("Подключено к %1").arg(connectedDeviceName));
@@ -127,6 +148,11 @@ void MainWindow::onConnectionEstablished()
     statusBar->showMessage("Подключение установлено", 3000);
 }
 
+void MainWindow::onConnectionFailed(const QString &reason)
+{
+    statusBar->showMessage(QString("Ошибка подключения: %1").arg(reason), 3000);
+}
+
 void MainWindow::onConnectionLost()
 {
     connectionStatus->setText("Не подключено");
@@ -137,3 +163,18 @@ void MainWindow::onConnectionLost()
     statusBar->showMessage("Соединение разорвано", 3000);
     chatDisplay->append("> Соединение потеряно");
 }
+
+void MainWindow::onSendProgress(const QString &filename, qint64 bytes, qint64 total)
+{
+    statusBar->showMessage(QString("Отправка %1: %2 из %3 байт").arg(filename).arg(bytes).arg(total));
+}
+
+void MainWindow::onReceiveProgress(const QString &filename, qint64 bytes, qint64 total)
+{
+    statusBar->showMessage(QString("Приём %1: %2 из %3 байт").arg(filename).arg(bytes).arg(total));
+}
+
+void MainWindow::onTransferFailed(const QString &filename, const QString &reason)
+{
+    chatDisplay->append(QString("Ошибка передачи файла %1: %2").arg(filename).arg(reason));
+}
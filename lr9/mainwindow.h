@@ -9,6 +9,7 @@
 #include <QStatusBar>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
+#include <QThread>
 #include "deviceemulator.h"
 #include "deviceselectiondialog.h"
 
@@ -20,6 +21,13 @@ public:
     explicit MainWindow(const QString &userType, QWidget *parent = nullptr);
     ~MainWindow();
 
+signals:
+    // Запросы к эмулятору, доставляются в его поток
+    void connectRequested(const QString &uuid);
+    void sendDataRequested(const QString &data);
+    void sendFileRequested(const QString &filePath);
+    void disconnectRequested();
+
 private slots:
     void on_scanButton_clicked();
     void on_sendButton_clicked();
@@ -28,8 +36,14 @@ private slots:
     void onDeviceSelected(const QString &uuid);
     void onDataReceived(const QString &data);
     void onFileReceived(const QString &filename);
+    void onFileSent(const QString &filename);
+    void onFileRejected(const QString &filename);
     void onConnectionEstablished();
+    void onConnectionFailed(const QString &reason);
     void onConnectionLost();
+    void onSendProgress(const QString &filename, qint64 bytes, qint64 total);
+    void onReceiveProgress(const QString &filename, qint64 bytes, qint64 total);
+    void onTransferFailed(const QString &filename, const QString &reason);
 
 private:
     QTextEdit *chatDisplay;
@@ -43,6 +57,7 @@ private:
     QStatusBar *statusBar;
 
     DeviceEmulator *deviceEmulator;
+    QThread *emulatorThread;
     QString currentUser;
     QString connectedDeviceName;
 };
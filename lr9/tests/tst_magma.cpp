@@ -0,0 +1,181 @@
+#include <QtTest>
+#include <QRandomGenerator>
+#include <cstring>
+#include "magma.h"
+#include "magmactr.h"
+#include "magmacmac.h"
+
+// Контрольные примеры ГОСТ Р 34.12-2015, ГОСТ Р 34.13-2015 и Р 1323565.1.017-2018 (ACPKM)
+// для шифра и его режимов
+class TestMagma : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void blockKnownAnswer();
+    void bulkMatchesSingleBlocks();
+    void vectorKernelMatchesScalar();
+    void ctrKnownAnswer();
+    void ctrAcpkmKnownAnswer();
+    void ctrRandomAccess();
+    void cmacKnownAnswer();
+    void cmacIncremental();
+
+private:
+    static QByteArray standardKey();
+    static QByteArray standardPlaintext();
+    static QByteArray randomBytes(int size);
+};
+
+QByteArray TestMagma::standardKey()
+{
+    return QByteArray::fromHex("ffeeddccbbaa99887766554433221100f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff");
+}
+
+QByteArray TestMagma::standardPlaintext()
+{
+    return QByteArray::fromHex("92def06b3c130a59db54c704f8189d204a98fb2e67a8024c8912409b17b57e41");
+}
+
+QByteArray TestMagma::randomBytes(int size)
+{
+    QByteArray data(size, Qt::Uninitialized);
+    for (char &byte : data) {
+        byte = char(QRandomGenerator::global()->bounded(256));
+    }
+    return data;
+}
+
+void TestMagma::blockKnownAnswer()
+{
+    // ГОСТ Р 34.12-2015, приложение А.2
+    Magma cipher;
+    cipher.setKey(standardKey());
+    QCOMPARE(cipher.encrypt(QByteArray::fromHex("fedcba9876543210")).toHex(), QByteArray("4ee901e5c2d8ca3d"));
+    QCOMPARE(cipher.decrypt(QByteArray::fromHex("4ee901e5c2d8ca3d")).toHex(), QByteArray("fedcba9876543210"));
+}
+
+void TestMagma::bulkMatchesSingleBlocks()
+{
+    // Пакетная обработка на месте совпадает с поблочной
+    Magma cipher;
+    cipher.setKey(standardKey());
+    const int blocks = 3;
+    const QByteArray plain = randomBytes(blocks * 8);
+    QByteArray data = plain;
+    cipher.encryptBlocks(reinterpret_cast<const uint8_t *>(data.constData()),
+                         reinterpret_cast<uint8_t *>(data.data()), blocks);
+    for (int i = 0; i < blocks; i++) {
+        QCOMPARE(data.mid(i * 8, 8), cipher.encrypt(plain.mid(i * 8, 8)));
+    }
+
+    cipher.decryptBlocks(reinterpret_cast<const uint8_t *>(data.constData()),
+                         reinterpret_cast<uint8_t *>(data.data()), blocks);
+    QCOMPARE(data, plain);
+}
+
+void TestMagma::vectorKernelMatchesScalar()
+{
+    // Группы по восемь блоков идут через векторное ядро, остаток и одиночные блоки — через
+    // скалярное; число блоков не кратно восьми, чтобы проверить оба пути
+    Magma cipher;
+    cipher.setKey(standardKey());
+    const int blocks = 37;
+    const QByteArray plain = randomBytes(blocks * 8);
+    QByteArray batch(plain.size(), Qt::Uninitialized);
+    cipher.encryptBlocks(reinterpret_cast<const uint8_t *>(plain.constData()),
+                         reinterpret_cast<uint8_t *>(batch.data()), blocks);
+    for (int i = 0; i < blocks; i++) {
+        QCOMPARE(batch.mid(i * 8, 8), cipher.encrypt(plain.mid(i * 8, 8)));
+    }
+
+    cipher.decryptBlocks(reinterpret_cast<const uint8_t *>(batch.constData()),
+                         reinterpret_cast<uint8_t *>(batch.data()), blocks);
+    QCOMPARE(batch, plain);
+}
+
+void TestMagma::ctrKnownAnswer()
+{
+    // ГОСТ Р 34.13-2015, приложение А.2.2
+    MagmaCtr ctr;
+    ctr.setKey(standardKey(), 0x12345678, 0);
+    QByteArray data = standardPlaintext();
+    ctr.apply(reinterpret_cast<uint8_t *>(data.data()), size_t(data.size()), 0);
+    QCOMPARE(data.toHex(), QByteArray("4e98110c97b7b93c3e250d93d6e85d69136d868807b2dbef568eb680ab52a12d"));
+}
+
+void TestMagma::ctrAcpkmKnownAnswer()
+{
+    // Р 1323565.1.017-2018, пример для Magma с секцией 16 байт
+    MagmaCtr ctr;
+    ctr.setKey(QByteArray::fromHex("8899aabbccddeeff0011223344556677fedcba98765432100123456789abcdef"), 0x12345678, 16);
+    QByteArray data = QByteArray::fromHex("1122334455667700ffeeddccbbaa998800112233445566778899aabbcceeff0a"
+                                          "112233445566778899aabbcceeff0a002233445566778899");
+    ctr.apply(reinterpret_cast<uint8_t *>(data.data()), size_t(data.size()), 0);
+    QCOMPARE(data.toHex(), QByteArray("2ab81deeeb1e4cab68e104c4bd6b94eac72c67af6c2e5b6b0eafb61770f1b32e"
+                                      "a1ae71149eed1382abd467180672ec6f84a2f15b3fca72c1"));
+}
+
+void TestMagma::ctrRandomAccess()
+{
+    // Буфер больше ParallelThreshold обрабатывается пулом; куски с невыровненными смещениями
+    // в обратном порядке заставляют пересчитывать ключи секций от исходного ключа
+    const QByteArray key = standardKey();
+    const QByteArray plain = randomBytes(int(4 * MagmaCtr::ParallelThreshold + 13));
+
+    MagmaCtr whole;
+    whole.setKey(key, 0xdeadbeef);
+    QByteArray expected = plain;
+    whole.apply(reinterpret_cast<uint8_t *>(expected.data()), size_t(expected.size()), 0);
+
+    MagmaCtr pieces;
+    pieces.setKey(key, 0xdeadbeef);
+    QByteArray actual = plain;
+    const int piece = 5003;
+    for (int offset = (actual.size() - 1) / piece * piece; offset >= 0; offset -= piece) {
+        int size = qMin(piece, actual.size() - offset);
+        pieces.apply(reinterpret_cast<uint8_t *>(actual.data()) + offset, size_t(size), quint64(offset));
+    }
+    QCOMPARE(actual, expected);
+
+    // Гамма обратима: повторное наложение возвращает открытый текст
+    whole.apply(reinterpret_cast<uint8_t *>(expected.data()), size_t(expected.size()), 0);
+    QCOMPARE(expected, plain);
+}
+
+void TestMagma::cmacKnownAnswer()
+{
+    // ГОСТ Р 34.13-2015, приложение А.2.6
+    MagmaCmac mac;
+    mac.setKey(standardKey());
+    const QByteArray data = standardPlaintext();
+    uint8_t tag[MagmaCmac::TagSize];
+    mac.update(reinterpret_cast<const uint8_t *>(data.constData()), size_t(data.size()));
+    mac.final(tag);
+    QCOMPARE(QByteArray(reinterpret_cast<const char *>(tag), sizeof(tag)).toHex(), QByteArray("154e72102030c5bb"));
+}
+
+void TestMagma::cmacIncremental()
+{
+    // Подача частями любой длины, в том числе с неполным последним блоком, не меняет имитовставку
+    MagmaCmac mac;
+    mac.setKey(standardKey());
+    const QByteArray data = randomBytes(101);
+    uint8_t expected[MagmaCmac::TagSize];
+    mac.update(reinterpret_cast<const uint8_t *>(data.constData()), size_t(data.size()));
+    mac.final(expected);
+
+    for (int step : { 1, 3, 8, 13 }) {
+        for (int offset = 0; offset < data.size(); offset += step) {
+            mac.update(reinterpret_cast<const uint8_t *>(data.constData()) + offset,
+                       size_t(qMin(step, data.size() - offset)));
+        }
+        uint8_t tag[MagmaCmac::TagSize];
+        mac.final(tag);
+        QVERIFY2(memcmp(tag, expected, sizeof(tag)) == 0, qPrintable(QString("step %1").arg(step)));
+    }
+}
+
+QTEST_APPLESS_MAIN(TestMagma)
+
+#include "tst_magma.moc"